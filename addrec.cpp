@@ -4,6 +4,7 @@
 // See the LICENSE file for more information.
 
 #include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallPtrSet.h>
 #include <llvm/Analysis/AssumptionCache.h>
 #include <llvm/Analysis/CmpInstAnalysis.h>
 #include <llvm/Analysis/ConstantFolding.h>
@@ -20,6 +21,7 @@
 #include <llvm/IR/GlobalValue.h>
 #include <llvm/IR/GlobalVariable.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InstIterator.h>
 #include <llvm/IR/InstVisitor.h>
 #include <llvm/IR/Instruction.h>
 #include <llvm/IR/Instructions.h>
@@ -44,6 +46,7 @@
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/ToolOutputFile.h>
 #include <llvm/Support/raw_ostream.h>
+#include "function-analyses.h"
 #include <cstdint>
 #include <cstdlib>
 #include <filesystem>
@@ -59,7 +62,55 @@ static cl::opt<std::string>
     InputDir(cl::Positional, cl::desc("<directory for input LLVM IR files>"),
              cl::Required, cl::value_desc("inputdir"));
 
+static cl::opt<bool>
+    Unique("unique",
+           cl::desc("Traverse the SCEV DAG of each function once and count "
+                    "unique AddRecs instead of AddRec occurrences"),
+           cl::init(false));
+
 static uint32_t Dist[1000];
+// Nodes visited by the traversals.
+static uint64_t Visits = 0;
+
+// Unique AddRecs by (operand count, loop depth).
+static std::map<std::pair<uint32_t, uint32_t>, uint64_t> UniqueDist;
+// Number of unique AddRecs with a given reference count. A reference is
+// either an instruction whose SCEV is the AddRec or an edge from another
+// SCEV node to it.
+static std::map<uint64_t, uint64_t> RefDist;
+
+// Walks the SCEVs of all instructions in F with one visited set, so shared
+// subexpressions are only expanded once.
+static void collectUniqueAddRecs(Function &F, ScalarEvolution &SE) {
+  SmallPtrSet<const SCEV *, 32> Visited;
+  SmallVector<const SCEV *, 32> Worklist;
+  DenseMap<const SCEVAddRecExpr *, uint64_t> Refs;
+  auto Reference = [&](const SCEV *S) {
+    if (auto *AddRec = dyn_cast<SCEVAddRecExpr>(S))
+      ++Refs[AddRec];
+    if (Visited.insert(S).second)
+      Worklist.push_back(S);
+  };
+
+  for (auto &I : instructions(F)) {
+    if (I.isTerminator() || I.mayHaveSideEffects() ||
+        !SE.isSCEVable(I.getType()))
+      continue;
+    Reference(SE.getSCEV(&I));
+    while (!Worklist.empty()) {
+      const SCEV *S = Worklist.pop_back_val();
+      ++Visits;
+      for (const SCEV *Op : S->operands())
+        Reference(Op);
+    }
+  }
+
+  for (auto &[AddRec, Count] : Refs) {
+    ++UniqueDist[{static_cast<uint32_t>(AddRec->getNumOperands()),
+                  AddRec->getLoop()->getLoopDepth()}];
+    ++RefDist[Count];
+  }
+}
 
 int main(int argc, char **argv) {
   InitLLVM Init{argc, argv};
@@ -98,17 +149,19 @@ int main(int argc, char **argv) {
       continue;
     // auto &DL = M->getDataLayout();
     // errs() << DL.getStringRepresentation() << '\n';
-    TargetLibraryInfoImpl TLIImpl{M->getTargetTriple()};
-
-    bool Contains = false;
+    ModuleAnalyses MA{*M};
     for (auto &F : *M) {
-      if (F.empty())
+      // AddRecs only exist for loops, and every loop has a header PHI.
+      auto *FA = MA.getIf(
+          F, [](const InstSummary &S) { return S.has(Instruction::PHI); });
+      if (!FA || FA->getLoopInfo().empty())
+        continue;
+      auto &SE = FA->getSE();
+
+      if (Unique) {
+        collectUniqueAddRecs(F, SE);
         continue;
-      TargetLibraryInfo TLI{TLIImpl, &F};
-      DominatorTree DT{F};
-      LoopInfo LI{DT};
-      AssumptionCache AC{F};
-      ScalarEvolution SE{F, TLI, AC, DT, LI};
+      }
 
       for (auto &BB : F) {
         for (auto &I : BB) {
@@ -120,6 +173,7 @@ int main(int argc, char **argv) {
 
           struct Follower final {
             bool follow(const SCEV *S) {
+              ++Visits;
               if (auto *AddRec = dyn_cast<SCEVAddRecExpr>(S))
                 ++Dist[AddRec->getNumOperands()];
 
@@ -138,6 +192,18 @@ int main(int argc, char **argv) {
     errs() << "\rProgress: " << ++Count;
   }
   errs() << '\n';
+  AnalysisCounters.print(errs());
+  errs() << "SCEV nodes visited: " << Visits << '\n';
+
+  if (Unique) {
+    errs() << "Operands Depth Count\n";
+    for (auto &[Key, Num] : UniqueDist)
+      errs() << Key.first << ' ' << Key.second << ' ' << Num << '\n';
+    errs() << "Refs Count\n";
+    for (auto &[Refs, Num] : RefDist)
+      errs() << Refs << ' ' << Num << '\n';
+    return EXIT_SUCCESS;
+  }
 
   for (uint32_t I = 0; I < 1000; ++I) {
     if (Dist[I] > 0)
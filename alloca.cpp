@@ -5,6 +5,7 @@
 
 #include <llvm/ADT/DenseMap.h>
 #include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/SmallVector.h>
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/DataLayout.h>
@@ -12,9 +13,11 @@
 #include <llvm/IR/Function.h>
 #include <llvm/IR/GlobalVariable.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InstIterator.h>
 #include <llvm/IR/InstVisitor.h>
 #include <llvm/IR/Instruction.h>
 #include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
 #include <llvm/IR/Intrinsics.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/Module.h>
@@ -30,6 +33,7 @@
 #include <llvm/Support/FileSystem.h>
 #include <llvm/Support/FormattedStream.h>
 #include <llvm/Support/InitLLVM.h>
+#include <llvm/Support/MathExtras.h>
 #include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/ToolOutputFile.h>
@@ -39,6 +43,7 @@
 #include <filesystem>
 #include <map>
 #include <memory>
+#include <optional>
 #include <unordered_map>
 
 using namespace llvm;
@@ -47,6 +52,163 @@ namespace fs = std::filesystem;
 static cl::opt<std::string>
     InputDir(cl::Positional, cl::desc("<directory for input LLVM IR files>"),
              cl::Required, cl::value_desc("inputdir"));
+static cl::opt<uint32_t>
+    MaxFound("max-found",
+             cl::desc("Report promotable scalar allocas in at most this many "
+                      "files (0 = no limit); the classification always "
+                      "covers the whole corpus"),
+             cl::init(20));
+
+// What keeps an alloca alive after mem2reg/SROA. Classes are ordered by
+// severity; an alloca gets the most severe class of any of its uses.
+enum AllocaClass : uint32_t {
+  // Only simple loads/stores of the allocated type (mem2reg).
+  Promotable,
+  // Constant-offset GEPs, type-punned accesses or fixed-size memory
+  // intrinsics, which SROA splits before promotion.
+  PromotableAfterSROA,
+  // The address flows into a PHI or select.
+  UsedByPHIOrSelect,
+  // The address is passed to a call.
+  EscapesViaCall,
+  // Anything else: volatile/atomic accesses, variable offsets, the address
+  // being stored, compared or converted to an integer.
+  Unpromotable,
+  NumAllocaClasses
+};
+
+static const char *getClassName(AllocaClass C) {
+  switch (C) {
+  case Promotable:
+    return "promotable";
+  case PromotableAfterSROA:
+    return "promotable-after-sroa";
+  case UsedByPHIOrSelect:
+    return "phi/select";
+  case EscapesViaCall:
+    return "escapes-via-call";
+  case Unpromotable:
+    return "unpromotable";
+  default:
+    llvm_unreachable("Unknown alloca class");
+  }
+}
+
+// Classifies all static allocas of a function. Derived pointers are only
+// followed through GEPs and casts, so each one belongs to a single alloca and
+// every instruction of the use-def web is visited once per function. The
+// worklist and the visited set are kept across allocas and functions.
+class AllocaClassifier final {
+  SmallVector<Instruction *, 16> WorkList;
+  SmallPtrSet<Instruction *, 32> Visited;
+
+  static AllocaClass classifyUse(AllocaInst *AI, Instruction *Ptr,
+                                 const Use &U) {
+    auto *UI = cast<Instruction>(U.getUser());
+    bool Direct = Ptr == AI;
+    if (auto *LI = dyn_cast<LoadInst>(UI)) {
+      if (!LI->isSimple())
+        return Unpromotable;
+      return Direct && LI->getType() == AI->getAllocatedType()
+                 ? Promotable
+                 : PromotableAfterSROA;
+    }
+    if (auto *SI = dyn_cast<StoreInst>(UI)) {
+      if (U.getOperandNo() != SI->getPointerOperandIndex() || !SI->isSimple())
+        return Unpromotable;
+      return Direct &&
+                     SI->getValueOperand()->getType() == AI->getAllocatedType()
+                 ? Promotable
+                 : PromotableAfterSROA;
+    }
+    if (isa<PHINode>(UI) || isa<SelectInst>(UI))
+      return UsedByPHIOrSelect;
+    if (auto *II = dyn_cast<IntrinsicInst>(UI)) {
+      if (II->isLifetimeStartOrEnd() || II->isDroppable() ||
+          isa<DbgInfoIntrinsic>(II))
+        return Promotable;
+      if (auto *MI = dyn_cast<MemIntrinsic>(II))
+        return !MI->isVolatile() && isa<ConstantInt>(MI->getLength())
+                   ? PromotableAfterSROA
+                   : Unpromotable;
+    }
+    if (isa<CallBase>(UI))
+      return EscapesViaCall;
+    return Unpromotable;
+  }
+
+public:
+  template <typename CallbackFn>
+  void classify(Function &F, CallbackFn Callback) {
+    Visited.clear();
+    for (auto &I : instructions(F)) {
+      auto *AI = dyn_cast<AllocaInst>(&I);
+      if (!AI || !AI->isStaticAlloca())
+        continue;
+      AllocaClass Class = Promotable;
+      WorkList.clear();
+      WorkList.push_back(AI);
+      while (!WorkList.empty() && Class != Unpromotable) {
+        auto *Ptr = WorkList.pop_back_val();
+        if (!Visited.insert(Ptr).second)
+          continue;
+        for (auto &U : Ptr->uses()) {
+          auto *UI = cast<Instruction>(U.getUser());
+          if (auto *GEP = dyn_cast<GetElementPtrInst>(UI)) {
+            if (!GEP->hasAllConstantIndices()) {
+              Class = Unpromotable;
+              break;
+            }
+            Class = std::max(Class, PromotableAfterSROA);
+            WorkList.push_back(GEP);
+            continue;
+          }
+          if (isa<BitCastInst>(UI) || isa<AddrSpaceCastInst>(UI)) {
+            Class = std::max(Class, PromotableAfterSROA);
+            WorkList.push_back(UI);
+            continue;
+          }
+          Class = std::max(Class, classifyUse(AI, Ptr, U));
+        }
+      }
+      Callback(AI, Class);
+    }
+  }
+};
+
+// Byte sizes of the allocas of each class, in power-of-two buckets: bucket
+// B holds sizes in [2^(B-1), 2^B), bucket 0 the empty allocas.
+struct SizeDistribution final {
+  uint64_t Count = 0;
+  uint64_t Bytes = 0;
+  uint64_t Scalable = 0;
+  std::map<uint32_t, uint64_t> Buckets;
+
+  void add(std::optional<TypeSize> Size) {
+    ++Count;
+    if (!Size || Size->isScalable()) {
+      ++Scalable;
+      return;
+    }
+    uint64_t Val = Size->getFixedValue();
+    Bytes += Val;
+    ++Buckets[Val ? Log2_64(Val) + 1 : 0];
+  }
+
+  void print(raw_ostream &OS) const {
+    OS << Count << " allocas, " << Bytes << " bytes";
+    if (Scalable)
+      OS << ", " << Scalable << " scalable";
+    OS << '\n';
+    for (auto [B, N] : Buckets) {
+      if (B == 0)
+        OS << "  0: " << N << '\n';
+      else
+        OS << "  [" << (1ULL << (B - 1)) << ", " << (1ULL << B)
+           << "): " << N << '\n';
+    }
+  }
+};
 
 int main(int argc, char **argv) {
   InitLLVM Init{argc, argv};
@@ -76,6 +238,8 @@ int main(int argc, char **argv) {
   LLVMContext Context;
   uint32_t Count = 0;
   uint32_t FindCount = 0;
+  AllocaClassifier Classifier;
+  SizeDistribution Dist[NumAllocaClasses];
 
   for (auto &Path : InputFiles) {
     SMDiagnostic Err;
@@ -83,78 +247,40 @@ int main(int argc, char **argv) {
     if (!M)
       continue;
     auto &DL = M->getDataLayout();
-    bool Found = false;
+    // Only the first promotable scalar alloca of a file is reported.
+    bool Found = MaxFound && FindCount >= MaxFound;
+    bool Reported = false;
     for (auto &F : *M) {
       if (F.empty())
         continue;
 
-      for (auto &I : F.getEntryBlock()) {
-        if (auto *AI = dyn_cast<AllocaInst>(&I)) {
-          if (!AI->getAllocatedType()->isIntOrPtrTy() &&
-              !AI->getAllocatedType()->isFloatTy())
-            continue;
-          if (auto Size = AI->getAllocationSizeInBits(DL);
-              Size.value_or(TypeSize::getFixed(128)) > 64)
-            continue;
-
-          SmallVector<Instruction *, 16> WorkList;
-          WorkList.push_back(AI);
-          SmallPtrSet<Instruction *, 16> Visited;
-          bool UsedByOther = false;
-          while (!WorkList.empty()) {
-            auto *I = WorkList.pop_back_val();
-            if (!Visited.insert(I).second)
-              continue;
-            for (auto *U : I->users()) {
-              if (auto *UI = dyn_cast<Instruction>(U)) {
-                if (isa<CallBase>(UI) || isa<PtrToIntInst>(UI) ||
-                    isa<PHINode>(UI) || isa<SelectInst>(UI)) {
-                  UsedByOther = true;
-                  break;
-                }
-
-                if (auto *LI = dyn_cast<LoadInst>(UI)) {
-                  if (!LI->isSimple() ||
-                      UI->getAccessType() != AI->getAllocatedType()) {
-                    UsedByOther = true;
-                    break;
-                  }
-                  continue;
-                }
-
-                if (auto *SI = dyn_cast<StoreInst>(UI)) {
-                  if (!SI->isSimple() || SI->getValueOperand() == I ||
-                      UI->getAccessType() != AI->getAllocatedType()) {
-                    UsedByOther = true;
-                    break;
-                  }
-                  continue;
-                }
-                WorkList.push_back(UI);
-              }
-            }
-          }
-          if (UsedByOther)
-            continue;
-          errs() << "Found alloca: " << *AI << ' ' << Path.string() << '\n';
-          Found = true;
-          break;
-        } else
-          break;
-      }
-
-      if (Found) {
-        ++FindCount;
-        break;
-      }
+      Classifier.classify(F, [&](AllocaInst *AI, AllocaClass Class) {
+        Dist[Class].add(AI->getAllocationSize(DL));
+        // Small scalars that mem2reg should already have promoted.
+        if (Found || Class != Promotable)
+          return;
+        Type *Ty = AI->getAllocatedType();
+        if (!Ty->isIntOrPtrTy() && !Ty->isFloatTy())
+          return;
+        if (auto Size = AI->getAllocationSizeInBits(DL);
+            Size.value_or(TypeSize::getFixed(128)) > 64)
+          return;
+        errs() << "Found alloca: " << *AI << ' ' << Path.string() << '\n';
+        Found = Reported = true;
+      });
     }
 
-    if (FindCount >= 20)
-      break;
-
+    FindCount += Reported;
     errs() << "\rProgress: " << ++Count;
   }
   errs() << '\n';
+  errs() << "Scanned files: " << Count << ", files with a promotable scalar "
+         << "alloca reported: " << FindCount << '\n';
+
+  for (uint32_t C = 0; C != NumAllocaClasses; ++C) {
+    outs() << getClassName(static_cast<AllocaClass>(C)) << ": ";
+    Dist[C].print(outs());
+  }
 
   return EXIT_SUCCESS;
 }
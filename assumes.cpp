@@ -3,16 +3,23 @@
 // This file is licensed under the MIT License.
 // See the LICENSE file for more information.
 
+// Catalogue of the conditions of llvm.assume calls and conditional branches.
+// Each condition is canonicalized into a shape: the opcodes, predicates and
+// flags of the expression tree up to --depth, with leaves reduced to their
+// kind (argument, constant class, ...). Values that occur more than once in
+// a shape become back-references, so `icmp (mul nuw X, X), C` keeps its
+// square. Shapes are hash-consed in one table for the whole corpus and
+// ranked by the number of assumes that use them. --query reruns the exact
+// matchers of the old assumes/assumes_square scanners in the same pass.
+
+#include <llvm/ADT/ArrayRef.h>
 #include <llvm/ADT/DenseMap.h>
-#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringMap.h>
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/Constants.h>
-#include <llvm/IR/DataLayout.h>
 #include <llvm/IR/DerivedTypes.h>
 #include <llvm/IR/Function.h>
-#include <llvm/IR/GlobalVariable.h>
-#include <llvm/IR/IRBuilder.h>
-#include <llvm/IR/InstVisitor.h>
 #include <llvm/IR/InstrTypes.h>
 #include <llvm/IR/Instruction.h>
 #include <llvm/IR/Instructions.h>
@@ -24,25 +31,22 @@
 #include <llvm/IR/PatternMatch.h>
 #include <llvm/IR/Type.h>
 #include <llvm/IR/Value.h>
-#include <llvm/IR/Verifier.h>
-#include <llvm/IRPrinter/IRPrintingPasses.h>
 #include <llvm/IRReader/IRReader.h>
+#include <llvm/Support/Allocator.h>
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/Error.h>
-#include <llvm/Support/ErrorHandling.h>
-#include <llvm/Support/FileSystem.h>
-#include <llvm/Support/FormattedStream.h>
+#include <llvm/Support/GlobPattern.h>
 #include <llvm/Support/InitLLVM.h>
-#include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Support/SourceMgr.h>
-#include <llvm/Support/ToolOutputFile.h>
 #include <llvm/Support/raw_ostream.h>
+#include <algorithm>
 #include <cstdint>
 #include <cstdlib>
 #include <filesystem>
-#include <map>
-#include <memory>
-#include <unordered_map>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
 
 using namespace llvm;
 using namespace PatternMatch;
@@ -51,6 +55,219 @@ namespace fs = std::filesystem;
 static cl::opt<std::string>
     InputDir(cl::Positional, cl::desc("<directory for input LLVM IR files>"),
              cl::Required, cl::value_desc("inputdir"));
+static cl::opt<uint32_t>
+    MaxDepth("depth", cl::desc("Depth of the expression tree kept in a shape"),
+             cl::init(3));
+static cl::opt<uint32_t> TopN("top",
+                              cl::desc("Number of shapes to print (0 = all)"),
+                              cl::init(100));
+static cl::opt<bool> IncludeBranches(
+    "branches", cl::desc("Also catalogue conditional branch conditions"),
+    cl::init(true));
+static cl::opt<std::string> ListShape(
+    "list",
+    cl::desc("Print the files that contain a shape matching this glob "
+             "pattern, e.g. 'icmp *(mul nuw*'"),
+    cl::init(""));
+
+// The queries of the scanners this catalogue replaced, which match
+// independently of how the operands are shaped.
+enum class LegacyQuery { None, Square, RemZero };
+static cl::opt<LegacyQuery> Query(
+    "query", cl::desc("Also run a query of the old assume scanners"),
+    cl::values(clEnumValN(LegacyQuery::Square, "square",
+                          "icmp (mul nuw X, X), RHS in assumes and branches"),
+               clEnumValN(LegacyQuery::RemZero, "rem-zero",
+                          "assume(icmp eq (rem X, C), 0)")),
+    cl::init(LegacyQuery::None));
+
+namespace {
+
+// Hash-consed shape nodes. A node is its label followed by the ids of its
+// operands; equal shapes get equal ids, so a condition is counted by id and
+// only the ranked shapes are ever turned back into strings.
+class ShapeTable final {
+  StringMap<uint32_t> LabelIds;
+  std::vector<StringRef> Labels;
+  DenseMap<ArrayRef<uint32_t>, uint32_t> NodeIds;
+  std::vector<ArrayRef<uint32_t>> Nodes;
+  BumpPtrAllocator Alloc;
+
+public:
+  uint32_t getLabel(StringRef Name) {
+    auto [It, Inserted] = LabelIds.try_emplace(Name, Labels.size());
+    if (Inserted)
+      Labels.push_back(It->first());
+    return It->second;
+  }
+
+  uint32_t intern(uint32_t Label, ArrayRef<uint32_t> Ops) {
+    SmallVector<uint32_t, 4> Key{Label};
+    Key.append(Ops.begin(), Ops.end());
+    if (auto It = NodeIds.find(Key); It != NodeIds.end())
+      return It->second;
+    auto *Mem = Alloc.Allocate<uint32_t>(Key.size());
+    std::copy(Key.begin(), Key.end(), Mem);
+    ArrayRef<uint32_t> Stored(Mem, Key.size());
+    NodeIds.try_emplace(Stored, Nodes.size());
+    Nodes.push_back(Stored);
+    return Nodes.size() - 1;
+  }
+
+  uint32_t size() const { return Nodes.size(); }
+
+  void print(raw_ostream &OS, uint32_t Id) const {
+    auto Node = Nodes[Id];
+    OS << Labels[Node.front()];
+    if (Node.size() == 1)
+      return;
+    OS << '(';
+    for (uint32_t I = 1; I != Node.size(); ++I) {
+      if (I != 1)
+        OS << ", ";
+      print(OS, Node[I]);
+    }
+    OS << ')';
+  }
+
+  std::string str(uint32_t Id) const {
+    std::string S;
+    raw_string_ostream OS(S);
+    print(OS, Id);
+    return S;
+  }
+};
+
+ShapeTable Shapes;
+
+void appendTypeClass(raw_ostream &OS, Type *Ty) {
+  if (auto *VTy = dyn_cast<VectorType>(Ty)) {
+    OS << ":v";
+    Ty = VTy->getElementType();
+  } else
+    OS << ':';
+  if (Ty->isIntegerTy(1))
+    OS << "i1";
+  else if (Ty->isIntegerTy())
+    OS << "iN";
+  else if (Ty->isPointerTy())
+    OS << "ptr";
+  else if (Ty->isFloatingPointTy())
+    OS << "fp";
+  else
+    OS << "other";
+}
+
+void printConstantKind(raw_ostream &OS, Constant *C) {
+  const APInt *Val;
+  if (isa<PoisonValue>(C))
+    OS << "poison";
+  else if (isa<UndefValue>(C))
+    OS << "undef";
+  else if (isa<GlobalValue>(C))
+    OS << "global";
+  else if (C->isNullValue())
+    OS << (C->getType()->isPtrOrPtrVectorTy() ? "null" : "0");
+  else if (match(C, m_APInt(Val))) {
+    if (Val->isOne())
+      OS << "1";
+    else if (Val->isAllOnes())
+      OS << "-1";
+    else if (Val->isMinSignedValue())
+      OS << "smin";
+    else if (Val->isMaxSignedValue())
+      OS << "smax";
+    else if (Val->isPowerOf2())
+      OS << "pow2";
+    else if (Val->isNegatedPowerOf2())
+      OS << "-pow2";
+    else if ((*Val + 1).isPowerOf2())
+      OS << "mask";
+    else
+      OS << "C";
+  } else if (isa<ConstantExpr>(C))
+    OS << "cexpr";
+  else
+    OS << "const";
+}
+
+void printInstLabel(raw_ostream &OS, Instruction *I) {
+  if (auto *II = dyn_cast<IntrinsicInst>(I))
+    OS << Intrinsic::getBaseName(II->getIntrinsicID());
+  else
+    OS << I->getOpcodeName();
+  if (auto *Cmp = dyn_cast<CmpInst>(I)) {
+    OS << ' ' << CmpInst::getPredicateName(Cmp->getPredicate());
+    if (auto *ICmp = dyn_cast<ICmpInst>(I); ICmp && ICmp->hasSameSign())
+      OS << " samesign";
+  }
+  if (isa<OverflowingBinaryOperator>(I)) {
+    if (I->hasNoUnsignedWrap())
+      OS << " nuw";
+    if (I->hasNoSignedWrap())
+      OS << " nsw";
+  }
+  if (isa<PossiblyExactOperator>(I) && I->isExact())
+    OS << " exact";
+  if (auto *PDI = dyn_cast<PossiblyDisjointInst>(I); PDI && PDI->isDisjoint())
+    OS << " disjoint";
+  if (isa<PossiblyNonNegInst>(I) && I->hasNonNeg())
+    OS << " nneg";
+  appendTypeClass(OS, I->getType());
+}
+
+// Builds the shape of V. Seen holds the non-constant values already placed
+// in the current shape in preorder, so an operand that repeats the K-th of
+// them becomes "$K".
+uint32_t buildShape(Value *V, uint32_t Depth, SmallVectorImpl<Value *> &Seen) {
+  std::string Label;
+  raw_string_ostream OS(Label);
+  if (auto *C = dyn_cast<Constant>(V)) {
+    printConstantKind(OS, C);
+    return Shapes.intern(Shapes.getLabel(OS.str()), {});
+  }
+  if (auto It = std::find(Seen.begin(), Seen.end(), V); It != Seen.end()) {
+    OS << '$' << (It - Seen.begin());
+    return Shapes.intern(Shapes.getLabel(OS.str()), {});
+  }
+  Seen.push_back(V);
+
+  auto *I = dyn_cast<Instruction>(V);
+  if (!I || Depth == 0 || isa<PHINode>(I) || isa<LoadInst>(I) ||
+      (isa<CallBase>(I) && !isa<IntrinsicInst>(I))) {
+    if (isa<Argument>(V))
+      OS << "arg";
+    else if (isa<PHINode>(V))
+      OS << "phi";
+    else if (isa<LoadInst>(V))
+      OS << "load";
+    else if (isa<CallBase>(V))
+      OS << "call";
+    else if (I)
+      OS << "inst";
+    else
+      OS << "val";
+    appendTypeClass(OS, V->getType());
+    return Shapes.intern(Shapes.getLabel(OS.str()), {});
+  }
+
+  printInstLabel(OS, I);
+  SmallVector<uint32_t, 4> Ops;
+  auto Operands = isa<CallBase>(I) ? cast<CallBase>(I)->args()
+                                   : make_range(I->op_begin(), I->op_end());
+  for (Value *Op : Operands)
+    Ops.push_back(buildShape(Op, Depth - 1, Seen));
+  return Shapes.intern(Shapes.getLabel(OS.str()), Ops);
+}
+
+uint32_t getShape(Value *Cond) {
+  SmallVector<Value *, 8> Seen;
+  return buildShape(Cond, MaxDepth, Seen);
+}
+
+enum ConditionSource { Assume, Branch, NumSources };
+
+} // namespace
 
 int main(int argc, char **argv) {
   InitLLVM Init{argc, argv};
@@ -79,38 +296,130 @@ int main(int argc, char **argv) {
   errs() << "Input files: " << InputFiles.size() << '\n';
   LLVMContext Context;
   uint32_t Count = 0;
+  // Occurrences of each shape id, per source.
+  std::vector<uint64_t> Freq[NumSources];
+  uint64_t Total[NumSources] = {};
+  std::optional<GlobPattern> ListPattern;
+  if (!ListShape.empty()) {
+    auto Pat = GlobPattern::create(ListShape);
+    if (!Pat) {
+      errs() << "--list: " << toString(Pat.takeError()) << '\n';
+      return EXIT_FAILURE;
+    }
+    ListPattern = std::move(*Pat);
+  }
+  // Whether each shape id matches --list, filled in on first use.
+  std::vector<int8_t> ListMatch;
+  uint64_t ListedConds[NumSources] = {};
+  std::set<std::string> ListedFiles;
+  uint64_t PatternCount = 0, ConstantRHSCount = 0;
+  std::set<std::string> QueryFiles;
 
   for (auto &Path : InputFiles) {
     SMDiagnostic Err;
     auto M = parseIRFile(Path.string(), Err, Context);
     if (!M)
       continue;
-    auto &DL = M->getDataLayout();
+    std::string RelPath = fs::relative(Path, std::string{InputDir}).string();
 
-    for (auto &F : *M) {
-      if (F.empty())
-        continue;
+    auto Visit = [&](Value *Cond, ConditionSource Source) {
+      uint32_t Id = getShape(Cond);
+      auto &F = Freq[Source];
+      if (F.size() <= Id)
+        F.resize(Shapes.size());
+      ++F[Id];
+      ++Total[Source];
+      if (!ListPattern)
+        return;
+      if (ListMatch.size() <= Id)
+        ListMatch.resize(Shapes.size(), -1);
+      if (ListMatch[Id] < 0)
+        ListMatch[Id] = ListPattern->match(Shapes.str(Id));
+      if (ListMatch[Id]) {
+        ++ListedConds[Source];
+        ListedFiles.insert(RelPath);
+      }
+    };
+
+    auto RunQuery = [&](Value *Cond, ConditionSource Source) {
+      Value *X, *RHS;
+      const APInt *C;
+      CmpPredicate Pred;
+      if (Query == LegacyQuery::Square &&
+          match(Cond, m_ICmp(Pred, m_NUWMul(m_Value(X), m_Deferred(X)),
+                             m_Value(RHS)))) {
+        ++PatternCount;
+        ConstantRHSCount += isa<Constant>(RHS);
+        QueryFiles.insert(RelPath);
+      }
+      if (Query == LegacyQuery::RemZero && Source == Assume &&
+          match(Cond, m_SpecificICmp(CmpInst::ICMP_EQ,
+                                     m_IRem(m_Value(X), m_APInt(C)),
+                                     m_Zero()))) {
+        errs() << "Found: " << *X << ' ' << *C << '\n';
+        QueryFiles.insert(RelPath);
+      }
+    };
 
+    for (auto &F : *M) {
       for (auto &BB : F) {
-        for (auto &I : BB) {
+        for (auto &I : BB)
           if (auto *AI = dyn_cast<AssumeInst>(&I)) {
-            Value *Cond = AI->getArgOperand(0);
-
-            Value *X;
-            const APInt *C;
-            if (match(Cond, m_SpecificICmp(CmpInst::ICMP_EQ,
-                                           m_IRem(m_Value(X), m_APInt(C)),
-                                           m_Zero()))) {
-              errs() << "Found: " << *X << ' ' << *C << '\n';
-            }
+            Visit(AI->getArgOperand(0), Assume);
+            RunQuery(AI->getArgOperand(0), Assume);
           }
-        }
+        auto *BI = dyn_cast<BranchInst>(BB.getTerminator());
+        if (!BI || !BI->isConditional())
+          continue;
+        if (IncludeBranches)
+          Visit(BI->getCondition(), Branch);
+        RunQuery(BI->getCondition(), Branch);
       }
     }
 
     errs() << "\rProgress: " << ++Count;
   }
   errs() << '\n';
+  for (auto &F : Freq)
+    F.resize(Shapes.size());
+
+  // Rank by assume count, then by branch count.
+  std::vector<uint32_t> Ranked;
+  for (uint32_t Id = 0; Id != Shapes.size(); ++Id)
+    if (Freq[Assume][Id] || Freq[Branch][Id])
+      Ranked.push_back(Id);
+  std::sort(Ranked.begin(), Ranked.end(), [&](uint32_t A, uint32_t B) {
+    if (Freq[Assume][A] != Freq[Assume][B])
+      return Freq[Assume][A] > Freq[Assume][B];
+    return Freq[Branch][A] > Freq[Branch][B];
+  });
+  errs() << "Assumes: " << Total[Assume] << ", branches: " << Total[Branch]
+         << ", distinct shapes: " << Ranked.size()
+         << ", shape nodes: " << Shapes.size() << '\n';
+
+  outs() << "assumes branches shape\n";
+  if (TopN && Ranked.size() > TopN)
+    Ranked.resize(TopN);
+  for (uint32_t Id : Ranked) {
+    outs() << Freq[Assume][Id] << ' ' << Freq[Branch][Id] << ' ';
+    Shapes.print(outs(), Id);
+    outs() << '\n';
+  }
+
+  if (ListPattern) {
+    errs() << "Listed: " << ListedConds[Assume] << " assumes, "
+           << ListedConds[Branch] << " branches in " << ListedFiles.size()
+           << " files\n";
+    for (auto &Path : ListedFiles)
+      errs() << Path << '\n';
+  }
+  if (Query == LegacyQuery::Square) {
+    errs() << "Pattern count: " << PatternCount << '\n';
+    errs() << "Constant RHS count: " << ConstantRHSCount << '\n';
+  }
+  if (Query != LegacyQuery::None)
+    for (auto &Path : QueryFiles)
+      errs() << Path << '\n';
 
   return EXIT_SUCCESS;
 }
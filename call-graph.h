@@ -0,0 +1,135 @@
+// SPDX-License-Identifier: MIT License
+// Copyright (c) 2025 Yingwei Zheng
+// This file is licensed under the MIT License.
+// See the LICENSE file for more information.
+
+// Direct call graph of a module, built in one walk over its instructions.
+// Recursion is answered with the SCCs of the graph rather than per-function
+// attributes, so mutual recursion is visible, and per-function facts used
+// by the recursion scanners are collected in the same walk.
+
+#pragma once
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Analysis/TargetLibraryInfo.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/PatternMatch.h>
+#include "phi-scc.h"
+#include <cstdint>
+#include <vector>
+
+namespace llvm {
+
+struct RecursiveReturn final {
+  ReturnInst *Ret;
+  // A direct call to a function in the same SCC whose result feeds Ret,
+  // either directly or as an operand of a binop or min/max.
+  CallInst *Call;
+};
+
+struct FunctionFacts final {
+  // Every call in the body is a call to a known library function.
+  bool LibFuncOnly = true;
+  bool HasSelfCall = false;
+  SmallVector<LibFunc, 4> LibFuncs;
+  SmallVector<RecursiveReturn, 2> RecursiveReturns;
+};
+
+class ModuleCallGraph final {
+  std::vector<Function *> Funcs;
+  DenseMap<const Function *, uint32_t> Index;
+  std::vector<FunctionFacts> Facts;
+  CSRGraph Calls;
+  SCCResult SCCs;
+
+  // Calls whose result is returned, possibly through a binop or min/max.
+  static void collectReturnedCalls(ReturnInst *Ret,
+                                   SmallVectorImpl<RecursiveReturn> &Out) {
+    using namespace PatternMatch;
+    Value *RetV = Ret->getReturnValue();
+    if (!RetV)
+      return;
+    auto Add = [&](Value *V) {
+      if (auto *Call = dyn_cast<CallInst>(V))
+        Out.push_back({Ret, Call});
+    };
+    Add(RetV);
+    Value *LHS, *RHS;
+    if (match(RetV, m_BinOp(m_Value(LHS), m_Value(RHS))) ||
+        match(RetV, m_MaxOrMin(m_Value(LHS), m_Value(RHS)))) {
+      Add(LHS);
+      Add(RHS);
+    }
+  }
+
+public:
+  ModuleCallGraph(Module &M, const TargetLibraryInfoImpl &TLIImpl) {
+    for (auto &F : M)
+      if (!F.isDeclaration()) {
+        Index.try_emplace(&F, Funcs.size());
+        Funcs.push_back(&F);
+      }
+    Facts.resize(Funcs.size());
+
+    // Returned calls are only known to be recursive once the SCCs exist.
+    std::vector<SmallVector<RecursiveReturn, 2>> Candidates(Funcs.size());
+    for (uint32_t U = 0; U != Funcs.size(); ++U) {
+      Function &F = *Funcs[U];
+      TargetLibraryInfo TLI(TLIImpl, &F);
+      auto &FF = Facts[U];
+      for (auto &I : instructions(F)) {
+        if (auto *Ret = dyn_cast<ReturnInst>(&I)) {
+          collectReturnedCalls(Ret, Candidates[U]);
+          continue;
+        }
+        auto *Call = dyn_cast<CallBase>(&I);
+        if (!Call)
+          continue;
+        auto *Callee = Call->getCalledFunction();
+        if (auto It = Index.find(Callee); Callee && It != Index.end()) {
+          Calls.addEdge(It->second);
+          FF.HasSelfCall |= Callee == &F;
+        }
+        LibFunc Func;
+        if (TLI.getLibFunc(*Call, Func))
+          FF.LibFuncs.push_back(Func);
+        else
+          FF.LibFuncOnly = false;
+      }
+      Calls.finishNode();
+    }
+
+    SCCs = computeSCCs(Calls);
+    for (uint32_t U = 0; U != Funcs.size(); ++U)
+      for (auto &R : Candidates[U]) {
+        auto It = Index.find(R.Call->getCalledFunction());
+        if (It != Index.end() &&
+            SCCs.Component[It->second] == SCCs.Component[U])
+          Facts[U].RecursiveReturns.push_back(R);
+      }
+  }
+
+  uint32_t size() const { return Funcs.size(); }
+  ArrayRef<Function *> functions() const { return Funcs; }
+
+  const FunctionFacts &getFacts(const Function &F) const {
+    return Facts[Index.lookup(&F)];
+  }
+
+  // Defined functions in the same SCC as F, including F.
+  ArrayRef<uint32_t> getSCC(const Function &F) const {
+    return SCCs.members(SCCs.Component[Index.lookup(&F)]);
+  }
+  Function *getFunction(uint32_t Idx) const { return Funcs[Idx]; }
+
+  bool isRecursive(const Function &F) const {
+    return getSCC(F).size() > 1 || getFacts(F).HasSelfCall;
+  }
+};
+
+} // namespace llvm
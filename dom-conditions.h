@@ -0,0 +1,144 @@
+// SPDX-License-Identifier: MIT License
+// Copyright (c) 2025 Yingwei Zheng
+// This file is licensed under the MIT License.
+// See the LICENSE file for more information.
+
+// Index of the conditions that are known to hold in a function. Each
+// dominating branch edge is recorded once as a (condition, polarity) fact
+// for the dominator subtree it guards, assumes are grouped by condition, and
+// conditions are looked up through the values they compare. Queries then
+// cost a few O(1) dominance checks instead of a walk up the dominator tree.
+
+#pragma once
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/PostOrderIterator.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/GlobalValue.h>
+#include <llvm/IR/InstrTypes.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/PatternMatch.h>
+#include <utility>
+
+namespace llvm {
+
+class DomConditionIndex final {
+  DominatorTree &DT;
+  // Blocks whose dominator subtree is guarded by a branch edge on which the
+  // condition has the given value.
+  DenseMap<const Value *, SmallVector<std::pair<const BasicBlock *, bool>, 2>>
+      Regions;
+  DenseMap<const Value *, SmallVector<AssumeInst *, 1>> Assumes;
+  // Indexed conditions that compare a value, or an operand of a binop that
+  // is compared. Constants other than globals are not keys.
+  DenseMap<const Value *, SmallVector<Value *, 2>> Mentions;
+  SmallPtrSet<const Value *, 16> Indexed;
+
+  void addMentions(Value *Cond) {
+    auto *Cmp = dyn_cast<ICmpInst>(Cond);
+    if (!Cmp || !Indexed.insert(Cond).second)
+      return;
+    auto Add = [&](Value *V) {
+      if (!isKey(V))
+        return;
+      auto &List = Mentions[V];
+      if (List.empty() || List.back() != Cond)
+        List.push_back(Cond);
+    };
+    for (Value *Op : Cmp->operands()) {
+      Add(Op);
+      if (auto *BO = dyn_cast<BinaryOperator>(Op)) {
+        Add(BO->getOperand(0));
+        Add(BO->getOperand(1));
+      }
+    }
+  }
+
+public:
+  static bool isKey(const Value *V) {
+    return !isa<Constant>(V) || isa<GlobalValue>(V);
+  }
+
+  DomConditionIndex(Function &F, DominatorTree &DT) : DT(DT) {
+    // Dominance checks below use the DFS numbering and are O(1).
+    DT.updateDFSNumbers();
+    for (auto *BB : ReversePostOrderTraversal<Function *>(&F)) {
+      for (auto &I : *BB)
+        if (auto *Assume = dyn_cast<AssumeInst>(&I)) {
+          Value *Cond = Assume->getArgOperand(0);
+          Assumes[Cond].push_back(Assume);
+          addMentions(Cond);
+        }
+
+      auto *BI = dyn_cast<BranchInst>(BB->getTerminator());
+      if (!BI || !BI->isConditional() ||
+          BI->getSuccessor(0) == BI->getSuccessor(1))
+        continue;
+      Value *Cond = BI->getCondition();
+      for (unsigned K = 0; K != 2; ++K) {
+        BasicBlockEdge Edge(BB, BI->getSuccessor(K));
+        if (!DT.dominates(Edge, Edge.getEnd()))
+          continue;
+        Regions[Cond].emplace_back(Edge.getEnd(), K == 0);
+        addMentions(Cond);
+      }
+    }
+  }
+
+  // Indexed conditions that mention V.
+  ArrayRef<Value *> getConditionsFor(const Value *V) const {
+    auto It = Mentions.find(V);
+    if (It == Mentions.end())
+      return {};
+    return It->second;
+  }
+
+  // Cond is known to be Polarity on entry to BB because of a dominating
+  // branch edge. Nothing is implied in unreachable blocks, which every block
+  // dominates.
+  bool isImpliedByBranch(const Value *Cond, bool Polarity,
+                         const BasicBlock *BB) const {
+    if (!DT.isReachableFromEntry(BB))
+      return false;
+    auto It = Regions.find(Cond);
+    if (It == Regions.end())
+      return false;
+    for (auto [Root, P] : It->second)
+      if (P == Polarity && DT.dominates(Root, BB))
+        return true;
+    return false;
+  }
+
+  // Cond is known to be true at CxtI because of an assume.
+  bool isImpliedByAssume(const Value *Cond, const Instruction *CxtI) const {
+    auto It = Assumes.find(Cond);
+    if (It == Assumes.end())
+      return false;
+    for (auto *Assume : It->second)
+      if (isValidAssumeForContext(Assume, CxtI, &DT))
+        return true;
+    return false;
+  }
+
+  // X == Y is implied on entry to BB by a dominating equality branch.
+  bool isEqualityImplied(const Value *X, const Value *Y,
+                         const BasicBlock *BB) const {
+    using namespace PatternMatch;
+    for (Value *Cond : getConditionsFor(isKey(X) ? X : Y)) {
+      CmpPredicate Pred;
+      if (match(Cond, m_c_ICmp(Pred, m_Specific(X), m_Specific(Y))) &&
+          ICmpInst::isEquality(Pred) &&
+          isImpliedByBranch(Cond, Pred == ICmpInst::ICMP_EQ, BB))
+        return true;
+    }
+    return false;
+  }
+};
+
+} // namespace llvm
@@ -25,6 +25,7 @@
 #include <llvm/IR/Function.h>
 #include <llvm/IR/GlobalValue.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InstIterator.h>
 #include <llvm/IR/InstVisitor.h>
 #include <llvm/IR/Instruction.h>
 #include <llvm/IR/Instructions.h>
@@ -55,6 +56,7 @@
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/ToolOutputFile.h>
 #include <llvm/Support/raw_ostream.h>
+#include "dom-conditions.h"
 #include <cassert>
 #include <cstdint>
 #include <cstdlib>
@@ -75,48 +77,25 @@ static cl::opt<std::string>
              cl::cat(ExtractorCategory));
 
 static bool visitFunc(Function &F) {
-  DominatorTree DT(F);
-  //   AssumptionCache AC(F);
-  //   DomConditionCache DC;
-  //   SimplifyQuery SQ{F.getParent()->getDataLayout(), nullptr, &DT, &AC};
-  //   SQ.DC = &DC;
-  //   ReversePostOrderTraversal<Function *> RPOT(&F);
-
-  for (auto &BB : F) {
-    for (auto &I : make_early_inc_range(BB)) {
-      if (auto *Cmp = dyn_cast<CmpInst>(&I)) {
-        auto *LHS = dyn_cast<LoadInst>(Cmp->getOperand(0));
-        auto *RHS = dyn_cast<LoadInst>(Cmp->getOperand(1));
-        if (LHS && RHS && LHS->isSimple() && RHS->isSimple()) {
-          auto *DTN = DT.getNode(&BB);
-
-          while (DTN && DTN->getIDom()) {
-            auto *DomBB = DTN->getIDom()->getBlock();
-            if (auto *Branch = dyn_cast<BranchInst>(DomBB->getTerminator())) {
-              CmpPredicate Pred;
-              if (Branch->isConditional() &&
-                  match(Branch->getCondition(),
-                        m_c_ICmp(Pred, m_Specific(LHS->getPointerOperand()),
-                                 m_Specific(RHS->getPointerOperand()))) &&
-                  ICmpInst::isEquality(Pred)) {
-                BasicBlockEdge Edge(DomBB, Pred == ICmpInst::ICMP_EQ
-                                               ? Branch->getSuccessor(0)
-                                               : Branch->getSuccessor(1));
-                if (DT.dominates(Edge, &BB))
-                  return true;
-              }
-            }
-
-            DTN = DTN->getIDom();
-          }
-        }
-      }
+  SmallVector<CmpInst *, 8> Cmps;
+  for (auto &I : instructions(F))
+    if (auto *Cmp = dyn_cast<CmpInst>(&I)) {
+      auto *LHS = dyn_cast<LoadInst>(Cmp->getOperand(0));
+      auto *RHS = dyn_cast<LoadInst>(Cmp->getOperand(1));
+      if (LHS && RHS && LHS->isSimple() && RHS->isSimple())
+        Cmps.push_back(Cmp);
     }
+  if (Cmps.empty())
+    return false;
 
-    // auto *BI = dyn_cast<BranchInst>(BB->getTerminator());
-    // if (!BI || BI->isUnconditional())
-    //   continue;
-    // DC.registerBranch(BI);
+  DominatorTree DT(F);
+  DomConditionIndex DC(F, DT);
+  for (auto *Cmp : Cmps) {
+    auto *LHS = cast<LoadInst>(Cmp->getOperand(0));
+    auto *RHS = cast<LoadInst>(Cmp->getOperand(1));
+    if (DC.isEqualityImplied(LHS->getPointerOperand(), RHS->getPointerOperand(),
+                             Cmp->getParent()))
+      return true;
   }
   return false;
 }
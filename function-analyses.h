@@ -0,0 +1,195 @@
+// SPDX-License-Identifier: MIT License
+// Copyright (c) 2025 Yingwei Zheng
+// This file is licensed under the MIT License.
+// See the LICENSE file for more information.
+
+// Lazily built per-function analyses for the scanners. A scanner first checks
+// the cheap InstSummary of a function (which opcodes and intrinsics occur in
+// it) and only asks for DominatorTree/LoopInfo/ScalarEvolution when the
+// function can match. Each analysis is built at most once per function, and
+// one TargetLibraryInfoImpl is shared by all modules with the same triple.
+
+#pragma once
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallSet.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Analysis/AssumptionCache.h>
+#include <llvm/Analysis/BlockFrequencyInfo.h>
+#include <llvm/Analysis/BranchProbabilityInfo.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/Analysis/TargetLibraryInfo.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instruction.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/TargetParser/Triple.h>
+#include <bitset>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+
+namespace llvm {
+
+// Opcodes and intrinsics used by a function, collected in one walk.
+class InstSummary final {
+  std::bitset<Instruction::OtherOpsEnd> Opcodes;
+  SmallSet<Intrinsic::ID, 8> Intrinsics;
+
+public:
+  explicit InstSummary(const Function &F) {
+    for (auto &I : instructions(F)) {
+      Opcodes.set(I.getOpcode());
+      if (auto *II = dyn_cast<IntrinsicInst>(&I))
+        Intrinsics.insert(II->getIntrinsicID());
+    }
+  }
+
+  bool has(unsigned Opcode) const { return Opcodes.test(Opcode); }
+  bool hasAny(std::initializer_list<unsigned> List) const {
+    for (auto Opcode : List)
+      if (has(Opcode))
+        return true;
+    return false;
+  }
+  bool hasIntrinsic(Intrinsic::ID ID) const { return Intrinsics.count(ID); }
+};
+
+// Number of analyses built, and of functions that never needed one.
+struct AnalysisStats final {
+  uint64_t Functions = 0;
+  uint64_t Filtered = 0;
+  uint64_t DomTrees = 0;
+  uint64_t LoopInfos = 0;
+  uint64_t ScalarEvolutions = 0;
+
+  void print(raw_ostream &OS) const {
+    OS << "Functions: " << Functions << ", filtered out: " << Filtered
+       << ", built DT/LI/SE: " << DomTrees << '/' << LoopInfos << '/'
+       << ScalarEvolutions << '\n';
+  }
+};
+inline AnalysisStats AnalysisCounters;
+
+// TargetLibraryInfoImpl only depends on the triple and is expensive to
+// build, so it is cached for the whole run.
+inline const TargetLibraryInfoImpl &getTLIImpl(const Module &M) {
+  static StringMap<std::unique_ptr<TargetLibraryInfoImpl>> Cache;
+  Triple TT(M.getTargetTriple());
+  auto &Entry = Cache[TT.str()];
+  if (!Entry)
+    Entry = std::make_unique<TargetLibraryInfoImpl>(TT);
+  return *Entry;
+}
+
+class FunctionAnalyses final {
+  Function &F;
+  const TargetLibraryInfoImpl &TLIImpl;
+  std::unique_ptr<InstSummary> Summary;
+  std::unique_ptr<DominatorTree> DT;
+  std::unique_ptr<LoopInfo> LI;
+  std::unique_ptr<AssumptionCache> AC;
+  std::unique_ptr<TargetLibraryInfo> TLI;
+  std::unique_ptr<ScalarEvolution> SE;
+  std::unique_ptr<BranchProbabilityInfo> BPI;
+  std::unique_ptr<BlockFrequencyInfo> BFI;
+
+public:
+  FunctionAnalyses(Function &F, const TargetLibraryInfoImpl &TLIImpl)
+      : F(F), TLIImpl(TLIImpl) {}
+
+  Function &getFunction() const { return F; }
+
+  const InstSummary &getSummary() {
+    if (!Summary)
+      Summary = std::make_unique<InstSummary>(F);
+    return *Summary;
+  }
+
+  DominatorTree &getDomTree() {
+    if (!DT) {
+      DT = std::make_unique<DominatorTree>(F);
+      ++AnalysisCounters.DomTrees;
+    }
+    return *DT;
+  }
+
+  LoopInfo &getLoopInfo() {
+    if (!LI) {
+      LI = std::make_unique<LoopInfo>(getDomTree());
+      ++AnalysisCounters.LoopInfos;
+    }
+    return *LI;
+  }
+
+  AssumptionCache &getAssumptionCache() {
+    if (!AC)
+      AC = std::make_unique<AssumptionCache>(F);
+    return *AC;
+  }
+
+  TargetLibraryInfo &getTLI() {
+    if (!TLI)
+      TLI = std::make_unique<TargetLibraryInfo>(TLIImpl, &F);
+    return *TLI;
+  }
+
+  ScalarEvolution &getSE() {
+    if (!SE) {
+      SE = std::make_unique<ScalarEvolution>(
+          F, getTLI(), getAssumptionCache(), getDomTree(), getLoopInfo());
+      ++AnalysisCounters.ScalarEvolutions;
+    }
+    return *SE;
+  }
+
+  BlockFrequencyInfo &getBFI() {
+    if (!BFI) {
+      BPI = std::make_unique<BranchProbabilityInfo>(F, getLoopInfo(),
+                                                    &getTLI());
+      BFI = std::make_unique<BlockFrequencyInfo>(F, *BPI, getLoopInfo());
+    }
+    return *BFI;
+  }
+};
+
+// Owns the FunctionAnalyses of one module, so that several checks over the
+// same function share them.
+class ModuleAnalyses final {
+  const TargetLibraryInfoImpl &TLIImpl;
+  DenseMap<const Function *, std::unique_ptr<FunctionAnalyses>> Cache;
+
+public:
+  explicit ModuleAnalyses(const Module &M) : TLIImpl(getTLIImpl(M)) {}
+  ModuleAnalyses(const ModuleAnalyses &) = delete;
+  ModuleAnalyses &operator=(const ModuleAnalyses &) = delete;
+
+  FunctionAnalyses &get(Function &F) {
+    auto &Entry = Cache[&F];
+    if (!Entry) {
+      Entry = std::make_unique<FunctionAnalyses>(F, TLIImpl);
+      ++AnalysisCounters.Functions;
+    }
+    return *Entry;
+  }
+
+  // Returns the analyses of F if its summary passes Filter, nullptr if the
+  // function is a declaration or cannot match.
+  template <typename FilterFn>
+  FunctionAnalyses *getIf(Function &F, FilterFn Filter) {
+    if (F.empty())
+      return nullptr;
+    auto &FA = get(F);
+    if (!Filter(FA.getSummary())) {
+      ++AnalysisCounters.Filtered;
+      return nullptr;
+    }
+    return &FA;
+  }
+};
+
+} // namespace llvm
@@ -10,17 +10,50 @@ alive_tv = sys.argv[2]
 work_dir = sys.argv[3]
 test_count = int(sys.argv[4])
 threads = int(sys.argv[5])
+# Optional: split each batch into chunks of this estimated verification cost
+chunk_cost = int(sys.argv[6]) if len(sys.argv) > 6 else 0
 
 if os.path.exists(work_dir):
     shutil.rmtree(work_dir)
 os.makedirs(work_dir)
 
+def verify(src, tgt):
+    try:
+        ret = subprocess.check_output([alive_tv, '--smt-to=300', '--disable-undef-input', src, tgt], timeout=120.0)
+    except Exception as e:
+        return False
+    if '0 incorrect transformations' in ret.decode('utf-8'):
+        os.remove(src)
+        os.remove(tgt)
+        return True
+    return False
+
+def fuzz_chunks(file):
+    index = file + '.index'
+    # All functions have been proven correct by the refuter
+    if not os.path.exists(index):
+        return True
+    ok = True
+    with open(index) as f:
+        for line in f:
+            chunk = file + '.' + line.split(' ')[0]
+            ok &= verify(chunk + '.src', chunk + '.tgt')
+    if ok:
+        os.remove(index)
+    return ok
+
 def fuzz(idx):
     file = os.path.join(work_dir, f't{idx}')
     try:
-        subprocess.check_call([gen, file], timeout=120.0)
+        if chunk_cost:
+            subprocess.check_call([gen, '--refute', f'--chunk-cost={chunk_cost}', file], timeout=120.0)
+            return fuzz_chunks(file)
+        subprocess.check_call([gen, '--refute', file], timeout=120.0)
         src = file + '.src'
         tgt = file + '.tgt'
+        # All functions have been proven correct by the refuter
+        if not os.path.exists(src) and not os.path.exists(tgt):
+            return True
         if not os.path.exists(src) or not os.path.exists(tgt):
             return
         ret = subprocess.check_output([alive_tv, '--smt-to=300', '--disable-undef-input', src, tgt], timeout=120.0)
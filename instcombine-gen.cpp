@@ -6,7 +6,11 @@
 #include <llvm/ADT/APInt.h>
 #include <llvm/ADT/ArrayRef.h>
 #include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/ADT/Hashing.h>
 #include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/ADT/StringMap.h>
 #include <llvm/Analysis/InstSimplifyFolder.h>
 #include <llvm/IR/Analysis.h>
 #include <llvm/IR/Attributes.h>
@@ -19,6 +23,7 @@
 #include <llvm/IR/Function.h>
 #include <llvm/IR/GlobalValue.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/InstIterator.h>
 #include <llvm/IR/InstVisitor.h>
 #include <llvm/IR/InstrTypes.h>
 #include <llvm/IR/Instruction.h>
@@ -40,6 +45,7 @@
 #include <llvm/Support/Error.h>
 #include <llvm/Support/ErrorHandling.h>
 #include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Format.h>
 #include <llvm/Support/FormattedStream.h>
 #include <llvm/Support/InitLLVM.h>
 #include <llvm/Support/MathExtras.h>
@@ -49,29 +55,355 @@
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/Transforms/InstCombine/InstCombine.h>
 #include <llvm/Transforms/Scalar/LoopPassManager.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include "opt-pipeline.h"
+#include "pair-writer.h"
+#include "refinement.h"
 #include "pcg_random.hpp"
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
 #include <cstdlib>
+#include <filesystem>
+#include <mutex>
 #include <random>
+#include <thread>
+#include <vector>
 
 using namespace llvm;
+namespace fs = std::filesystem;
+
+static cl::opt<std::string>
+    OutputName(cl::Positional, cl::desc("<output prefix for a single batch>"),
+               cl::Optional, cl::value_desc("output"));
+
+static cl::opt<uint32_t> Jobs("jobs", cl::desc("Number of generator threads"),
+                              cl::init(1));
+
+static cl::opt<uint32_t>
+    Count("count",
+          cl::desc("Number of batches to generate (0 = a single batch written "
+                   "to the positional output prefix)"),
+          cl::init(0));
+
+static cl::opt<std::string>
+    OutputDir("output-dir", cl::desc("Directory for generated batches"),
+              cl::init("."), cl::value_desc("dir"));
+
+static cl::opt<std::string> Prefix("prefix",
+                                   cl::desc("File name prefix of each batch"),
+                                   cl::init("t"));
+
+static cl::opt<uint32_t>
+    ShardSize("shard-size",
+              cl::desc("Number of batches per subdirectory (0 = flat)"),
+              cl::init(0));
+
+static cl::opt<uint64_t>
+    Seed("seed", cl::desc("Base seed (default: a random seed)"), cl::init(0));
+
+static cl::list<std::string>
+    Replay("replay",
+           cl::desc("Regenerate only the named functions (func<idx>_<seed>) "
+                    "into the positional output prefix"),
+           cl::CommaSeparated, cl::value_desc("func"));
+
+static cl::opt<bool>
+    Refute("refute",
+           cl::desc("Check each function exhaustively before emitting it. "
+                    "Functions proven correct are dropped from the output"),
+           cl::init(false));
+
+static cl::opt<uint64_t>
+    RefuteLimit("refute-limit",
+                cl::desc("Maximum number of inputs enumerated per function"),
+                cl::init(1U << 20));
+
+static cl::opt<bool> Guided(
+    "coverage-guided",
+    cl::desc("Adapt generator weights towards functions whose InstCombine "
+             "rewrite exercises transforms that have not been seen yet"),
+    cl::init(false));
+
+static cl::opt<std::string>
+    CoverageLog("coverage-log",
+                cl::desc("Append coverage over time as CSV "
+                         "(seconds,batches,functions,features)"),
+                cl::value_desc("file"));
+
+static cl::opt<bool> RejectionSampling(
+    "rejection-sampling",
+    cl::desc("Use the original builder that discards functions which do not "
+             "end up with every argument used and a single root. Replaying a "
+             "function requires the builder it was generated with"),
+    cl::init(false));
+
+static cl::opt<uint32_t>
+    Bench("bench",
+          cl::desc("Generate N functions with each builder and report "
+                   "throughput and rejection rate instead of writing batches"),
+          cl::init(0), cl::value_desc("N"));
+
+static cl::opt<uint64_t> ChunkCost(
+    "chunk-cost",
+    cl::desc("Split each batch into <output>.<k>.src/.tgt chunks of about "
+             "this estimated verification cost, listed in <output>.index "
+             "(0 = a single pair)"),
+    cl::init(0));
+
+static cl::opt<bool> CompileTime(
+    "compile-time",
+    cl::desc("Measure InstCombine iterations and time per function instead "
+             "of writing src/tgt pairs. Functions over the limits are "
+             "minimized and saved as <output>.<func>.ll"),
+    cl::init(false));
+
+static cl::opt<uint32_t> IterationLimit(
+    "iteration-limit",
+    cl::desc("Report functions that need more InstCombine iterations to "
+             "reach a fixpoint"),
+    cl::init(1));
+
+static cl::opt<uint32_t>
+    TimeLimit("time-limit-us",
+              cl::desc("Report functions whose InstCombine run takes longer "
+                       "(0 = no limit)"),
+              cl::init(1000));
+
+static std::atomic_uint64_t RefuteCorrect{0};
+static std::atomic_uint64_t RefuteIncorrect{0};
+static std::atomic_uint64_t RefuteUnknown{0};
+static std::atomic_uint64_t CTChecked{0};
+static std::atomic_uint64_t CTOverIterations{0};
+static std::atomic_uint64_t CTOverTime{0};
+static std::atomic_uint64_t CTMicros{0};
 
 constexpr uint32_t MinArgs = 1U;
 constexpr uint32_t MaxArgs = 3U;
 constexpr uint32_t MinInsts = 3U;
 constexpr uint32_t MaxInsts = 12U;
 constexpr uint32_t BatchSize = 1024U;
+// Iterations after which InstCombine is assumed to loop forever.
+constexpr uint32_t MaxIterations = 100U;
+
+static constexpr Instruction::BinaryOps BinOps[] = {
+    Instruction::Add,  Instruction::Sub,  Instruction::Mul,  Instruction::SDiv,
+    Instruction::UDiv, Instruction::SRem, Instruction::URem, Instruction::And,
+    Instruction::Or,   Instruction::Xor,  Instruction::Shl,  Instruction::LShr,
+    Instruction::AShr,
+};
+static constexpr Instruction::BinaryOps BoolBinOps[] = {
+    Instruction::And,
+    Instruction::Or,
+    Instruction::Xor,
+};
+
+// splitmix64 finalizer. Used to derive independent per-batch and
+// per-function seeds from the base seed.
+static uint64_t mixSeed(uint64_t Base, uint64_t Idx) {
+  uint64_t Z = Base + (Idx + 1) * 0x9e3779b97f4a7c15ULL;
+  Z = (Z ^ (Z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  Z = (Z ^ (Z >> 27)) * 0x94d049bb133111ebULL;
+  return Z ^ (Z >> 31);
+}
+
+constexpr uint32_t NumCategories = 9U;
+
+// Generator weights adapted by --coverage-guided. The defaults reproduce the
+// uniform choices of the unguided generator.
+struct GenWeights final {
+  double Category[NumCategories] = {1, 1, 1, 1, 1, 1, 1, 1, 1};
+  double ConstProb = 0.5;
+  double FlagProb = 0.5;
+};
+
+// Choices made while generating one function.
+struct GenUsage final {
+  uint32_t Category[NumCategories] = {};
+  uint32_t Consts = 0;
+  uint32_t Values = 0;
+  uint32_t FlagsSet = 0;
+  uint32_t FlagsClear = 0;
+};
+
+// The InstCombine rewrite of a function is summarized as a set of features:
+// which instruction kinds were removed or introduced, which removed kind was
+// replaced by which introduced kind, and how the returned value changed. A
+// feature that has not been seen before means that a new transform (or a new
+// combination of transforms) fired.
+static uint64_t getInstKind(Value *V) {
+  auto *I = dyn_cast<Instruction>(V);
+  if (!I)
+    return isa<Argument>(V) ? 1 : 2;
+  uint64_t Kind = I->getOpcode();
+  if (auto *II = dyn_cast<IntrinsicInst>(I))
+    Kind = hash_combine(Kind, II->getIntrinsicID());
+  else if (auto *Cmp = dyn_cast<CmpInst>(I))
+    Kind = hash_combine(Kind, Cmp->getPredicate());
+  return hash_combine(Kind, I->getType()->getScalarSizeInBits());
+}
+
+static void collectFeatures(Function &Src, Function &Tgt,
+                            SmallVectorImpl<uint64_t> &Features) {
+  SmallDenseMap<uint64_t, int32_t, 16> Delta;
+  for (auto &I : instructions(Src))
+    --Delta[getInstKind(&I)];
+  for (auto &I : instructions(Tgt))
+    ++Delta[getInstKind(&I)];
+  SmallVector<uint64_t, 8> Removed, Added;
+  for (auto [Kind, D] : Delta) {
+    if (D < 0)
+      Removed.push_back(Kind);
+    else if (D > 0)
+      Added.push_back(Kind);
+  }
+  if (Removed.empty() && Added.empty())
+    return;
+  for (auto Kind : Removed)
+    Features.push_back(hash_combine(1, Kind));
+  for (auto Kind : Added)
+    Features.push_back(hash_combine(2, Kind));
+  for (auto From : Removed)
+    for (auto To : Added)
+      Features.push_back(hash_combine(3, From, To));
+  auto GetRetKind = [](Function &F) -> uint64_t {
+    auto *Ret = cast<ReturnInst>(F.getEntryBlock().getTerminator());
+    return getInstKind(Ret->getReturnValue());
+  };
+  Features.push_back(hash_combine(4, GetRetKind(Src), GetRetKind(Tgt)));
+}
+
+class CoverageMap final {
+  std::mutex Lock;
+  DenseSet<uint64_t> Seen;
+  uint64_t Batches = 0;
+  uint64_t Funcs = 0;
+  std::chrono::steady_clock::time_point Start =
+      std::chrono::steady_clock::now();
+  std::unique_ptr<raw_fd_ostream> Log;
+
+public:
+  bool openLog(StringRef Path) {
+    std::error_code EC;
+    Log = std::make_unique<raw_fd_ostream>(Path, EC, sys::fs::OF_Append);
+    if (EC) {
+      errs() << Path << ": " << EC.message() << '\n';
+      return false;
+    }
+    return true;
+  }
+  // Returns the number of features that have not been seen before.
+  uint32_t add(ArrayRef<uint64_t> Features) {
+    std::lock_guard Guard(Lock);
+    ++Funcs;
+    uint32_t New = 0;
+    for (auto Feature : Features)
+      New += Seen.insert(Feature).second;
+    return New;
+  }
+  void finishBatch() {
+    std::lock_guard Guard(Lock);
+    ++Batches;
+    if (!Log)
+      return;
+    std::chrono::duration<double> Elapsed =
+        std::chrono::steady_clock::now() - Start;
+    *Log << format("%.1f", Elapsed.count()) << ',' << Batches << ',' << Funcs
+         << ',' << Seen.size() << '\n';
+    Log->flush();
+  }
+  size_t size() {
+    std::lock_guard Guard(Lock);
+    return Seen.size();
+  }
+};
+
+static CoverageMap Coverage;
+
+struct InstCombineCost final {
+  // Number of InstCombine iterations that changed the function.
+  uint32_t Iterations = 0;
+  bool Fixpoint = true;
+  uint64_t Micros = 0;
+
+  bool isOverLimit() const {
+    return !Fixpoint || Iterations > IterationLimit ||
+           (TimeLimit && Micros > TimeLimit);
+  }
+};
+
+// Instruction mix of the generated functions, reported by --bench.
+enum GenOpKind {
+  OpBinary,
+  OpICmp,
+  OpSelect,
+  OpIntrinsic,
+  OpCast,
+  OpOther,
+  NumOpKinds
+};
+static constexpr const char *GenOpNames[NumOpKinds] = {
+    "binop", "icmp", "select", "intrinsic", "cast", "other"};
+
+static GenOpKind getGenOpKind(const Instruction &I) {
+  if (isa<BinaryOperator>(I))
+    return OpBinary;
+  if (isa<ICmpInst>(I))
+    return OpICmp;
+  if (isa<SelectInst>(I))
+    return OpSelect;
+  if (isa<IntrinsicInst>(I))
+    return OpIntrinsic;
+  if (isa<CastInst>(I))
+    return OpCast;
+  return OpOther;
+}
+
+struct GenStats final {
+  uint64_t Funcs = 0;
+  // Number of functions started, including the discarded ones.
+  uint64_t Attempts = 0;
+  uint64_t Insts = 0;
+  uint64_t Ops[NumOpKinds] = {};
+};
 
 class FuncGenerator final {
   pcg64 Rng;
   LLVMContext Ctx;
   Module M;
+  OptPipeline InstCombine;
+  // A single InstCombine iteration, without the fixpoint verification.
+  OptPipeline InstCombineStep;
   SmallVector<IntegerType *, 4> Types;
+  GenWeights Weights;
+  GenUsage Usage;
+  StringMap<GenUsage> FuncUsage;
+  GenStats Stats;
+  bool Constructive;
   uint32_t randomUInt(uint32_t Min, uint32_t Max) {
     return std::uniform_int_distribution<uint32_t>(Min, Max)(Rng);
   }
   uint32_t randomUInt(uint32_t Max) { return randomUInt(0, Max); }
   bool randomBool() { return randomUInt(1); }
+  bool randomProb(double P) {
+    if (!Guided)
+      return randomBool();
+    return std::bernoulli_distribution(P)(Rng);
+  }
+  uint32_t randomCategory() {
+    if (!Guided)
+      return randomUInt(NumCategories - 1);
+    return std::discrete_distribution<uint32_t>(std::begin(Weights.Category),
+                                                std::end(Weights.Category))(
+        Rng);
+  }
+  bool randomFlag() {
+    bool Set = randomProb(Weights.FlagProb);
+    ++(Set ? Usage.FlagsSet : Usage.FlagsClear);
+    return Set;
+  }
   IntegerType *randomType() { return Types[randomUInt(Types.size() - 1)]; }
   IntegerType *randomNonBoolType() {
     return Types[randomUInt(1, Types.size() - 1)];
@@ -96,7 +428,12 @@ class FuncGenerator final {
   }
   Value *selectTypedVal(IntegerType *Ty) {
     auto &Set = TypedValues[Ty];
-    if (Set.empty() || randomBool()) {
+    bool UseConst = Set.empty();
+    if (!UseConst) {
+      UseConst = randomProb(Weights.ConstProb);
+      ++(UseConst ? Usage.Consts : Usage.Values);
+    }
+    if (UseConst) {
       uint32_t Bits = Ty->getScalarSizeInBits();
       return ConstantInt::get(Ty, APInt(Bits, randomUInt((1U << Bits) - 1)));
     }
@@ -113,8 +450,33 @@ class FuncGenerator final {
     }
     return Values[randomUInt(Values.size() - 1)];
   }
+  Value *createCast(Value *Val, Type *TgtTy) {
+    auto *Cast = Builder.CreateIntCast(Val, TgtTy, randomBool());
+    if (auto *Trunc = dyn_cast<TruncInst>(Cast)) {
+      Trunc->setHasNoSignedWrap(randomFlag());
+      Trunc->setHasNoUnsignedWrap(randomFlag());
+    }
+    if (auto *NNeg = dyn_cast<PossiblyNonNegInst>(Cast))
+      NNeg->setNonNeg(randomFlag());
+    return Cast;
+  }
+  Value *createBinOp(Instruction::BinaryOps BinOp, Value *LHS, Value *RHS) {
+    auto *Inst = dyn_cast<Instruction>(Builder.CreateBinOp(BinOp, LHS, RHS));
+    if (!Inst)
+      return nullptr;
+    if (isa<OverflowingBinaryOperator>(Inst)) {
+      Inst->setHasNoSignedWrap(randomFlag());
+      Inst->setHasNoUnsignedWrap(randomFlag());
+    } else if (isa<PossiblyExactOperator>(Inst))
+      Inst->setIsExact(randomFlag());
+    else if (auto *Disjoint = dyn_cast<PossiblyDisjointInst>(Inst))
+      Disjoint->setIsDisjoint(randomFlag());
+    return Inst;
+  }
   Value *selectInst() {
-    switch (randomUInt(8)) {
+    uint32_t Category = randomCategory();
+    ++Usage.Category[Category];
+    switch (Category) {
     case 0: {
       return nullptr;
       // auto Val = selectVal();
@@ -127,14 +489,7 @@ class FuncGenerator final {
         auto TgtTy = randomType();
         if (TgtTy == Val->getType())
           return nullptr;
-        auto *Cast = Builder.CreateIntCast(Val, TgtTy, randomBool());
-        if (auto *Trunc = dyn_cast<TruncInst>(Cast)) {
-          Trunc->setHasNoSignedWrap(randomBool());
-          Trunc->setHasNoUnsignedWrap(randomBool());
-        }
-        if (auto *NNeg = dyn_cast<PossiblyNonNegInst>(Cast))
-          NNeg->setNonNeg(randomBool());
-        return Cast;
+        return createCast(Val, TgtTy);
       }
       break;
     }
@@ -142,29 +497,12 @@ class FuncGenerator final {
       auto *Ty = randomType();
       auto *LHS = selectTypedVal(Ty);
       auto *RHS = selectTypedVal(Ty);
-      static constexpr Instruction::BinaryOps BinOps[] = {
-          Instruction::Add,  Instruction::Sub,  Instruction::Mul,
-          Instruction::SDiv, Instruction::UDiv, Instruction::SRem,
-          Instruction::URem, Instruction::And,  Instruction::Or,
-          Instruction::Xor,  Instruction::Shl,  Instruction::LShr,
-          Instruction::AShr,
-      };
       auto BinOp = BinOps[randomUInt(std::size(BinOps) - 1U)];
       if (Ty->isIntegerTy(1) && BinOp != Instruction::And &&
           BinOp != Instruction::Or && BinOp != Instruction::Xor)
         return nullptr;
 
-      auto *Inst = dyn_cast<Instruction>(Builder.CreateBinOp(BinOp, LHS, RHS));
-      if (!Inst)
-        return nullptr;
-      if (isa<OverflowingBinaryOperator>(Inst)) {
-        Inst->setHasNoSignedWrap(randomBool());
-        Inst->setHasNoUnsignedWrap(randomBool());
-      } else if (isa<PossiblyExactOperator>(Inst))
-        Inst->setIsExact(randomBool());
-      else if (auto *Disjoint = dyn_cast<PossiblyDisjointInst>(Inst))
-        Disjoint->setIsDisjoint(randomBool());
-      return Inst;
+      return createBinOp(BinOp, LHS, RHS);
     }
     case 3: {
       auto *Ty = randomNonBoolType();
@@ -272,17 +610,46 @@ class FuncGenerator final {
   }
 
 public:
-  explicit FuncGenerator()
-      : Rng(pcg_extras::seed_seq_from<std::random_device>{}), M("", Ctx),
-        Builder(Ctx) {
+  explicit FuncGenerator(bool Constructive = !RejectionSampling)
+      : M("", Ctx), Builder(Ctx), Constructive(Constructive) {
     Types.push_back(IntegerType::get(Ctx, 1));
     Types.push_back(IntegerType::get(Ctx, 4));  // Non-legal
     Types.push_back(IntegerType::get(Ctx, 8));  // Legal
     Types.push_back(IntegerType::get(Ctx, 16)); // Legal
+    cantFail(InstCombine.parse("instcombine"));
+    cantFail(InstCombineStep.parseFunction(
+        "instcombine<max-iterations=1;no-verify-fixpoint>"));
+  }
+  // Drop all functions so that the generator can be reused for a new batch.
+  void reset() {
+    FuncUsage.clear();
+    for (auto &F : M)
+      F.dropAllReferences();
+    while (!M.empty())
+      M.begin()->eraseFromParent();
   }
-  bool addFunc(uint32_t Idx) {
+  // The function only depends on SubSeed, so it can be regenerated on its own
+  // from its name.
+  void generateFunc(uint32_t Idx, uint64_t SubSeed) {
+    Rng.seed(SubSeed);
+    if (Constructive)
+      buildFunc(Idx, SubSeed);
+    else
+      while (!addFunc(Idx, SubSeed))
+        ;
+    ++Stats.Funcs;
+    auto &Entry = M.getFunctionList().back().getEntryBlock();
+    Stats.Insts += Entry.size();
+    for (auto &I : Entry)
+      ++Stats.Ops[getGenOpKind(I)];
+  }
+  const GenStats &getStats() const { return Stats; }
+  // Creates the function with its arguments and an empty entry block.
+  Function *createFunc(uint32_t Idx, uint64_t SubSeed) {
+    ++Stats.Attempts;
     Values.clear();
     TypedValues.clear();
+    Usage = GenUsage{};
 
     uint32_t ArgNum = randomUInt(MinArgs, MaxArgs);
     SmallVector<Type *, MaxArgs> argTypes;
@@ -290,10 +657,12 @@ public:
       argTypes.push_back(randomType());
     // Type *RetType = randomType();
     Type *RetType = Builder.getInt16Ty();
-    auto F = Function::Create(FunctionType::get(RetType, argTypes,
+    auto *F = Function::Create(FunctionType::get(RetType, argTypes,
                                                 /*isVarArg=*/false),
                               GlobalValue::ExternalLinkage,
-                              "func" + std::to_string(Idx), M);
+                              "func" + std::to_string(Idx) + "_" +
+                                  utohexstr(SubSeed, /*LowerCase=*/true),
+                              M);
     for (auto &Arg : F->args()) {
       if (randomBool())
         Arg.addAttr(Attribute::NoUndef);
@@ -317,6 +686,15 @@ public:
     }
     auto Entry = BasicBlock::Create(Ctx, "", F);
     Builder.SetInsertPoint(Entry);
+    return F;
+  }
+  // Rejection sampling: emits random instructions and discards the function
+  // unless it ends up with ExpectedInsts instructions, every argument used and
+  // a single unused root.
+  bool addFunc(uint32_t Idx, uint64_t SubSeed) {
+    auto *F = createFunc(Idx, SubSeed);
+    auto *Entry = &F->getEntryBlock();
+    Type *RetType = F->getReturnType();
     uint32_t ExpectedInsts = randomUInt(MinInsts, MaxInsts);
 
     auto IsReady = [&]() -> Value * {
@@ -342,6 +720,7 @@ public:
     do {
       if (auto Ret = IsReady()) {
         Builder.CreateRet(Builder.CreateIntCast(Ret, RetType, randomBool()));
+        FuncUsage[F->getName()] = Usage;
         return true;
       }
       if (Entry->size() == ExpectedInsts) {
@@ -363,48 +742,484 @@ public:
       }
     } while (true);
   }
-  void dump(raw_ostream &out) const {
-    assert(!verifyModule(M, &errs()) && "Module is broken");
-    M.print(out, nullptr);
+  // Number of instructions the closing phase of buildFunc needs in the worst
+  // case: one extractvalue per unused struct, then a cast and an operation to
+  // merge each pair of unused integers.
+  static uint32_t getClosingCost(uint32_t Ints, uint32_t Structs) {
+    uint32_t Roots = Ints + Structs;
+    return Structs + (Roots ? 2 * (Roots - 1) : 0);
   }
-  void runInstCombine() {
-    PassBuilder PB;
+  uint32_t getClosingCost() const {
+    uint32_t Ints = 0, Structs = 0;
+    for (auto *V : Values)
+      if (V->use_empty())
+        ++(V->getType()->isIntegerTy() ? Ints : Structs);
+    return getClosingCost(Ints, Structs);
+  }
+  // Combines two values of the same integer type into a new root.
+  Value *createCombine(Value *LHS, Value *RHS) {
+    if (LHS->getType()->isIntegerTy(1))
+      return createBinOp(BoolBinOps[randomUInt(std::size(BoolBinOps) - 1U)],
+                         LHS, RHS);
+    switch (randomUInt(2)) {
+    case 0:
+      return createBinOp(BinOps[randomUInt(std::size(BinOps) - 1U)], LHS, RHS);
+    case 1: {
+      static constexpr Intrinsic::ID MinMax[] = {
+          Intrinsic::smin,
+          Intrinsic::smax,
+          Intrinsic::umin,
+          Intrinsic::umax,
+      };
+      return Builder.CreateBinaryIntrinsic(
+          MinMax[randomUInt(std::size(MinMax) - 1U)], LHS, RHS);
+    }
+    default:
+      return Builder.CreateIntrinsic(
+          LHS->getType(), randomBool() ? Intrinsic::ucmp : Intrinsic::scmp,
+          {LHS, RHS});
+    }
+  }
+  // Constructive builder: every function is accepted. Random instructions are
+  // emitted while the budget still covers the closing cost; a step that
+  // overshoots it is rolled back and ends the random phase. The closing phase
+  // then merges all unused values into a single root, and the root is
+  // extended until the planned size is reached.
+  void buildFunc(uint32_t Idx, uint64_t SubSeed) {
+    auto *F = createFunc(Idx, SubSeed);
+    auto *Entry = &F->getEntryBlock();
+    uint32_t ExpectedInsts =
+        std::max(randomUInt(MinInsts, MaxInsts), getClosingCost());
 
-    LoopAnalysisManager LAM;
-    FunctionAnalysisManager FAM;
-    CGSCCAnalysisManager CGAM;
-    ModulePassManager MPM;
-    ModuleAnalysisManager MAM;
+    // The budget is checked against the actual cost of each step rather than
+    // the worst case, which would leave small functions with no room for
+    // random instructions at all.
+    while (Entry->size() + 1 + getClosingCost() < ExpectedInsts) {
+      uint32_t OldSize = Entry->size();
+      GenUsage OldUsage = Usage;
+      auto *V = selectInst();
+      bool Added = V && isa<Instruction>(V);
+      if (Added)
+        addValue(V);
+      if (Entry->size() + 1 + getClosingCost() <= ExpectedInsts)
+        continue;
+      if (Added) {
+        Values.pop_back();
+        TypedValues[V->getType()].pop_back();
+      }
+      // Later instructions only use earlier ones.
+      while (Entry->size() > OldSize)
+        Entry->back().eraseFromParent();
+      Usage = OldUsage;
+      break;
+    }
 
-    PB.registerModuleAnalyses(MAM);
-    PB.registerCGSCCAnalyses(CGAM);
-    PB.registerFunctionAnalyses(FAM);
-    PB.registerLoopAnalyses(LAM);
-    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+    SmallVector<Value *, MaxArgs + MaxInsts> Roots;
+    for (auto *V : Values)
+      if (V->use_empty())
+        Roots.push_back(V);
+    for (auto *&V : Roots) {
+      if (!V->getType()->isIntegerTy()) {
+        V = Builder.CreateExtractValue(V, randomUInt(1));
+        addValue(V);
+      }
+    }
+    while (Roots.size() > 1) {
+      auto *LHS = Roots.pop_back_val();
+      uint32_t Pos = randomUInt(Roots.size() - 1);
+      auto *RHS = Roots[Pos];
+      if (randomBool())
+        std::swap(LHS, RHS);
+      if (RHS->getType() != LHS->getType()) {
+        RHS = createCast(RHS, LHS->getType());
+        addValue(RHS);
+      }
+      Roots[Pos] = createCombine(LHS, RHS);
+      addValue(Roots[Pos]);
+    }
 
-    MPM.addPass(createModuleToFunctionPassAdaptor(InstCombinePass{}));
-    MPM.run(M, MAM);
+    auto *Root = Roots.front();
+    while (Entry->size() < ExpectedInsts) {
+      auto *Ty = cast<IntegerType>(Root->getType());
+      auto *TgtTy = randomType();
+      if (TgtTy != Ty && randomUInt(3) == 0)
+        Root = createCast(Root, TgtTy);
+      else
+        Root = createCombine(Root, selectTypedVal(Ty));
+      addValue(Root);
+    }
+    Builder.CreateRet(
+        Builder.CreateIntCast(Root, F->getReturnType(), randomBool()));
+    FuncUsage[F->getName()] = Usage;
+  }
+  void dump(raw_ostream &out) const {
+    assert(!verifyModule(M, &errs()) && "Module is broken");
+    M.print(out, nullptr);
+  }
+  void runInstCombine() { InstCombine.run(M); }
+  // Moves the weights towards the choices made by a function that hit unseen
+  // features, and slightly away from them otherwise. The weights decay towards
+  // uniform so that a category is never starved.
+  void reward(const GenUsage &U, uint32_t NewFeatures) {
+    constexpr double Rate = 0.05;
+    constexpr double Decay = 0.01;
+    constexpr double MinWeight = 0.05;
+    double Gain = NewFeatures ? Rate * std::min(NewFeatures, 8U) : -Rate / 4;
+    uint32_t Total = 0;
+    for (auto C : U.Category)
+      Total += C;
+    double Sum = 0.0;
+    for (uint32_t I = 0; I != NumCategories; ++I) {
+      double &W = Weights.Category[I];
+      if (Total)
+        W *= std::exp(Gain * U.Category[I] / Total);
+      W = std::max(MinWeight, W * (1.0 - Decay) + Decay);
+      Sum += W;
+    }
+    for (auto &W : Weights.Category)
+      W *= NumCategories / Sum;
+    if (!NewFeatures)
+      return;
+    auto Follow = [&](double &P, uint32_t Yes, uint32_t No) {
+      if (Yes + No)
+        P += Rate * (double(Yes) / (Yes + No) - P);
+      P = std::clamp(P, 0.1, 0.9);
+    };
+    Follow(Weights.ConstProb, U.Consts, U.Values);
+    Follow(Weights.FlagProb, U.FlagsSet, U.FlagsClear);
+  }
+  // Compares every function in SrcM with its optimized version, records the
+  // transform features in the global coverage map and updates the weights.
+  void updateCoverage(Module &SrcM) {
+    SmallVector<uint64_t, 32> Features;
+    for (auto &SrcF : SrcM) {
+      if (SrcF.empty())
+        continue;
+      Features.clear();
+      collectFeatures(SrcF, *M.getFunction(SrcF.getName()), Features);
+      uint32_t New = Coverage.add(Features);
+      if (Guided)
+        reward(FuncUsage.lookup(SrcF.getName()), New);
+    }
+    Coverage.finishBatch();
+  }
+  // Runs single InstCombine iterations on a copy of F until one of them
+  // leaves it unchanged.
+  InstCombineCost measureInstCombine(Function &F) {
+    ValueToValueMapTy VMap;
+    auto *Tmp = CloneFunction(&F, VMap);
+    InstCombineCost Cost;
+    auto Start = std::chrono::steady_clock::now();
+    while (InstCombineStep.run(*Tmp)) {
+      if (++Cost.Iterations == MaxIterations) {
+        Cost.Fixpoint = false;
+        break;
+      }
+    }
+    Cost.Micros = std::chrono::duration_cast<std::chrono::microseconds>(
+                      std::chrono::steady_clock::now() - Start)
+                      .count();
+    Tmp->eraseFromParent();
+    return Cost;
+  }
+  // Replaces the Idx-th instruction of the single-block function F with the
+  // Choice-th candidate: one of its operands of the same type, or zero.
+  static bool reduceInst(Function &F, uint32_t Idx, uint32_t Choice) {
+    auto &I = *std::next(F.getEntryBlock().begin(), Idx);
+    SmallVector<Value *, 4> Candidates;
+    for (auto &Op : I.operands())
+      if (Op->getType() == I.getType() && !isa<Constant>(Op))
+        Candidates.push_back(Op);
+    Candidates.push_back(Constant::getNullValue(I.getType()));
+    if (Choice >= Candidates.size())
+      return false;
+    I.replaceAllUsesWith(Candidates[Choice]);
+    I.eraseFromParent();
+    return true;
+  }
+  // Greedily drops instructions from F while IsInteresting still holds for the
+  // InstCombine cost. Returns the reduced function, which takes F's name.
+  Function *
+  minimize(Function *F,
+           function_ref<bool(const InstCombineCost &)> IsInteresting) {
+    for (uint32_t Idx = 0; Idx + 1 < F->getEntryBlock().size();) {
+      bool Reduced = false;
+      for (uint32_t Choice = 0; !Reduced; ++Choice) {
+        ValueToValueMapTy VMap;
+        auto *Cand = CloneFunction(F, VMap);
+        if (!reduceInst(*Cand, Idx, Choice)) {
+          Cand->eraseFromParent();
+          break;
+        }
+        if (!IsInteresting(measureInstCombine(*Cand))) {
+          Cand->eraseFromParent();
+          continue;
+        }
+        Cand->takeName(F);
+        F->eraseFromParent();
+        F = Cand;
+        Reduced = true;
+      }
+      if (!Reduced)
+        ++Idx;
+    }
+    return F;
+  }
+  // Saves F and the declarations it uses as a standalone module.
+  bool saveFunc(Function &F, const std::string &Path,
+                const InstCombineCost &Orig, const InstCombineCost &Min) {
+    auto Out = CloneModule(M);
+    for (auto &Fn : *Out)
+      if (Fn.getName() != F.getName())
+        Fn.deleteBody();
+    for (auto &Fn : make_early_inc_range(*Out))
+      if (Fn.getName() != F.getName() && Fn.use_empty())
+        Fn.eraseFromParent();
+    std::error_code EC;
+    raw_fd_ostream OS(Path, EC);
+    if (EC) {
+      errs() << Path << ": " << EC.message() << '\n';
+      return false;
+    }
+    OS << "; iterations: " << Orig.Iterations << " -> " << Min.Iterations
+       << ", fixpoint: " << (Min.Fixpoint ? "yes" : "no")
+       << ", time: " << Orig.Micros << "us -> " << Min.Micros << "us\n";
+    Out->print(OS, nullptr);
+    return true;
+  }
+  // Compile-time mode: measures every function of the batch, then minimizes
+  // and saves the ones over the iteration or time limit.
+  bool checkCompileTime(const std::string &Name) {
+    SmallVector<Function *, 0> Funcs;
+    for (auto &F : M)
+      if (!F.empty())
+        Funcs.push_back(&F);
+    for (auto *F : Funcs) {
+      auto Cost = measureInstCombine(*F);
+      ++CTChecked;
+      CTMicros += Cost.Micros;
+      if (!Cost.isOverLimit())
+        continue;
+      bool OverIterations = !Cost.Fixpoint || Cost.Iterations > IterationLimit;
+      ++(OverIterations ? CTOverIterations : CTOverTime);
+      // Time is noisy, so a function that is slow but converges quickly is
+      // only reduced while it stays slow.
+      auto *Min = minimize(F, [&](const InstCombineCost &C) {
+        if (OverIterations)
+          return !C.Fixpoint || C.Iterations > IterationLimit;
+        return C.Micros > TimeLimit;
+      });
+      std::string FuncName = Min->getName().str();
+      if (!saveFunc(*Min, Name + "." + FuncName + ".ll", Cost,
+                    measureInstCombine(*Min)))
+        return false;
+    }
+    return true;
+  }
+  std::unique_ptr<Module> cloneModule() const { return CloneModule(M); }
+  const Module &getModule() const { return M; }
+  // Drops the functions that the brute-force refuter proves correct from both
+  // SrcM and the optimized module. Returns the number of remaining functions.
+  uint32_t refute(Module &SrcM) {
+    uint32_t Remaining = 0;
+    for (auto &SrcF : make_early_inc_range(SrcM)) {
+      if (SrcF.empty())
+        continue;
+      auto *TgtF = M.getFunction(SrcF.getName());
+      std::string CE;
+      raw_string_ostream OS(CE);
+      switch (checkRefinement(SrcF, *TgtF, RefuteLimit, &OS)) {
+      case RefineResult::Correct:
+        ++RefuteCorrect;
+        SrcF.eraseFromParent();
+        TgtF->eraseFromParent();
+        continue;
+      case RefineResult::Incorrect:
+        ++RefuteIncorrect;
+        errs() << "Refuted: " << SrcF.getName() << '\n' << CE;
+        break;
+      case RefineResult::Unknown:
+        ++RefuteUnknown;
+        break;
+      }
+      ++Remaining;
+    }
+    return Remaining;
   }
 };
 
-int main(int argc, char **argv) {
-  InitLLVM Init{argc, argv};
+static bool isCoverageTracked() { return Guided || !CoverageLog.empty(); }
 
-  std::string Name = argv[1];
-  std::error_code ec;
-  auto OutSrc = std::make_unique<llvm::ToolOutputFile>(Name + ".src", ec,
+static bool writeBatch(FuncGenerator &Gen, const std::string &Name,
+                       function_ref<void()> Generate) {
+  if (CompileTime) {
+    Gen.reset();
+    Generate();
+    return Gen.checkCompileTime(Name);
+  }
+  Gen.reset();
+  Generate();
+  if (Refute || isCoverageTracked() || ChunkCost) {
+    auto SrcM = Gen.cloneModule();
+    Gen.runInstCombine();
+    if (isCoverageTracked())
+      Gen.updateCoverage(*SrcM);
+    // Nothing is left for alive2, so the outputs are not kept.
+    if (Refute && !Gen.refute(*SrcM))
+      return true;
+    return writePairs(*SrcM, Gen.getModule(), Name, ChunkCost);
+  }
+  std::error_code EC;
+  auto OutSrc = std::make_unique<llvm::ToolOutputFile>(Name + ".src", EC,
                                                        llvm::sys::fs::OF_None);
-  auto OutTgt = std::make_unique<llvm::ToolOutputFile>(Name + ".tgt", ec,
+  if (EC) {
+    errs() << Name << ".src: " << EC.message() << '\n';
+    return false;
+  }
+  auto OutTgt = std::make_unique<llvm::ToolOutputFile>(Name + ".tgt", EC,
                                                        llvm::sys::fs::OF_None);
-  FuncGenerator Gen;
-  for (uint32_t I = 0; I < BatchSize; ++I)
-    while (!Gen.addFunc(I))
-      ;
+  if (EC) {
+    errs() << Name << ".tgt: " << EC.message() << '\n';
+    return false;
+  }
   Gen.dump(OutSrc->os());
   OutSrc->keep();
   OutSrc.reset();
   Gen.runInstCombine();
   Gen.dump(OutTgt->os());
   OutTgt->keep();
-  return EXIT_SUCCESS;
+  return true;
+}
+
+static bool generateBatch(FuncGenerator &Gen, const std::string &Name,
+                          uint64_t BatchSeed) {
+  return writeBatch(Gen, Name, [&] {
+    for (uint32_t I = 0; I < BatchSize; ++I)
+      Gen.generateFunc(I, mixSeed(BatchSeed, I));
+  });
+}
+
+static bool replayFuncs(FuncGenerator &Gen, const std::string &Name) {
+  SmallVector<std::pair<uint32_t, uint64_t>> Funcs;
+  for (StringRef FuncName : Replay) {
+    auto [IdxStr, SeedStr] = FuncName.rsplit('_');
+    uint32_t Idx;
+    uint64_t SubSeed;
+    if (!IdxStr.consume_front("func") || IdxStr.getAsInteger(10, Idx) ||
+        SeedStr.getAsInteger(16, SubSeed)) {
+      errs() << "error: invalid function name " << FuncName << '\n';
+      return false;
+    }
+    Funcs.emplace_back(Idx, SubSeed);
+  }
+  return writeBatch(Gen, Name, [&] {
+    for (auto [Idx, SubSeed] : Funcs)
+      Gen.generateFunc(Idx, SubSeed);
+  });
+}
+
+// Builds the same functions with both builders, without running InstCombine.
+static void runBench(uint64_t BaseSeed) {
+  for (bool Constructive : {false, true}) {
+    FuncGenerator Gen{Constructive};
+    auto Start = std::chrono::steady_clock::now();
+    for (uint32_t I = 0; I < Bench; ++I) {
+      if (I % BatchSize == 0)
+        Gen.reset();
+      Gen.generateFunc(I % BatchSize, mixSeed(BaseSeed, I));
+    }
+    std::chrono::duration<double> Elapsed =
+        std::chrono::steady_clock::now() - Start;
+    auto &Stats = Gen.getStats();
+    outs() << (Constructive ? "constructive" : "rejection") << ": "
+           << format("%.0f", Stats.Funcs / Elapsed.count())
+           << " functions/s, rejection rate "
+           << format("%.2f%%", 100.0 * (Stats.Attempts - Stats.Funcs) /
+                                   Stats.Attempts)
+           << ", " << format("%.1f", double(Stats.Insts) / Stats.Funcs)
+           << " instructions/function\n  ";
+    for (uint32_t K = 0; K != NumOpKinds; ++K)
+      outs() << (K ? ", " : "") << GenOpNames[K] << ' '
+             << format("%.1f%%", 100.0 * Stats.Ops[K] / Stats.Insts);
+    outs() << '\n';
+  }
+}
+
+static std::string getBatchName(uint32_t Idx) {
+  fs::path Dir{std::string{OutputDir}};
+  if (ShardSize) {
+    char Shard[16];
+    std::snprintf(Shard, sizeof(Shard), "%06u", Idx / ShardSize);
+    Dir /= Shard;
+  }
+  return (Dir / (std::string{Prefix} + std::to_string(Idx))).string();
+}
+
+// Refuter, compile-time and coverage totals of the run.
+static void printSummary() {
+  if (Refute)
+    errs() << "Refuter: " << RefuteCorrect << " correct, " << RefuteIncorrect
+           << " incorrect, " << RefuteUnknown << " unknown\n";
+  if (CompileTime) {
+    uint64_t Checked = std::max<uint64_t>(1, CTChecked);
+    errs() << "Compile time: " << CTChecked << " functions, "
+           << CTOverIterations << " over the iteration limit, " << CTOverTime
+           << " over the time limit, "
+           << format("%.1f", double(CTMicros) / Checked) << "us/function\n";
+  }
+  if (isCoverageTracked())
+    errs() << "Transform features covered: " << Coverage.size() << '\n';
+}
+
+int main(int argc, char **argv) {
+  InitLLVM Init{argc, argv};
+  cl::ParseCommandLineOptions(argc, argv, "InstCombine fuzzer generator\n");
+
+  uint64_t BaseSeed = Seed;
+  if (!Seed.getNumOccurrences()) {
+    std::random_device RD;
+    BaseSeed = (uint64_t(RD()) << 32) | RD();
+  }
+  if (!CoverageLog.empty() && !Coverage.openLog(CoverageLog))
+    return EXIT_FAILURE;
+
+  if (Bench) {
+    runBench(BaseSeed);
+    return EXIT_SUCCESS;
+  }
+
+  if (Count == 0 || !Replay.empty()) {
+    if (OutputName.empty()) {
+      errs() << "error: expected an output prefix or --count\n";
+      return EXIT_FAILURE;
+    }
+    FuncGenerator Gen;
+    bool Ok = Replay.empty() ? generateBatch(Gen, OutputName, BaseSeed)
+                             : replayFuncs(Gen, OutputName);
+    printSummary();
+    return Ok ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  for (uint32_t Idx = 0; Idx < Count; Idx += ShardSize ? ShardSize : Count)
+    fs::create_directories(fs::path{getBatchName(Idx)}.parent_path());
+
+  std::atomic_uint32_t Next{0};
+  std::atomic_uint32_t Done{0};
+  std::atomic_bool Failed{false};
+  {
+    std::vector<std::jthread> Workers;
+    for (uint32_t I = 0; I < std::max(1U, uint32_t(Jobs)); ++I)
+      Workers.emplace_back([&] {
+        FuncGenerator Gen;
+        for (uint32_t Idx = Next++; Idx < Count && !Failed; Idx = Next++) {
+          if (!generateBatch(Gen, getBatchName(Idx), mixSeed(BaseSeed, Idx)))
+            Failed = true;
+          ++Done;
+        }
+      });
+  }
+  errs() << "Generated batches: " << Done << " (seed " << BaseSeed << ")\n";
+  printSummary();
+
+  return Failed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -38,11 +38,14 @@
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/ToolOutputFile.h>
 #include <llvm/Support/raw_ostream.h>
+#include "dom-conditions.h"
+#include "function-analyses.h"
 #include <cstdint>
 #include <cstdlib>
 #include <filesystem>
 #include <map>
 #include <memory>
+#include <optional>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -93,63 +96,42 @@ int main(int argc, char **argv) {
       continue;
     auto &DL = M->getDataLayout();
 
+    ModuleAnalyses MA{*M};
     for (auto &F : *M) {
-      if (F.empty())
+      auto *FA = MA.getIf(F, [](const InstSummary &S) {
+        return S.hasAny({Instruction::SDiv, Instruction::UDiv});
+      });
+      if (!FA)
         continue;
 
-      SmallVector<Instruction *, 16> AssumeInsts;
-      for (auto &BB : F) {
-        for (auto &I : BB) {
-          if (isa<AssumeInst>(&I)) {
-            AssumeInsts.push_back(&I);
-          }
-        }
-      }
-
-      DominatorTree DT{F};
+      std::optional<DomConditionIndex> DC;
+      auto IsRemZero = [](Value *Cond, ICmpInst::Predicate Pred, Value *X,
+                          Value *Y) {
+        return match(Cond, m_SpecificICmp(Pred,
+                                          m_IRem(m_Specific(X), m_Specific(Y)),
+                                          m_Zero()));
+      };
+      // Conditions are not indexed under non-global constants.
+      auto GetConditions = [&](Value *X, Value *Y) {
+        return DC->getConditionsFor(DomConditionIndex::isKey(X) ? X : Y);
+      };
 
       auto IsImpliedByAssumes = [&](Instruction *I, Value *X, Value *Y) {
-        for (auto *Assume : AssumeInsts) {
-          Value *Cond = Assume->getOperand(0);
-          if (!match(Cond, m_SpecificICmp(ICmpInst::ICMP_EQ,
-                                          m_IRem(m_Specific(X), m_Specific(Y)),
-                                          m_Zero())))
-            continue;
-          if (isValidAssumeForContext(Assume, I, &DT))
+        for (auto *Cond : GetConditions(X, Y))
+          if (IsRemZero(Cond, ICmpInst::ICMP_EQ, X, Y) &&
+              DC->isImpliedByAssume(Cond, I))
             return true;
-        }
         return false;
       };
 
       auto IsImpliedByDominatingConditions = [&](Instruction *I, Value *X,
                                                  Value *Y) {
-        auto *BB = I->getParent();
-        if (!DT.isReachableFromEntry(BB))
-          return false;
-        auto *Node = DT.getNode(BB);
-        while (Node->getIDom()) {
-          auto *Pred = Node->getIDom();
-
-          if (auto *BI =
-                  dyn_cast<BranchInst>(Pred->getBlock()->getTerminator());
-              BI && BI->isConditional()) {
-            auto *Cond = BI->getCondition();
-
-            if (BI->getSuccessor(0) != BI->getSuccessor(1)) {
-              ICmpInst::Predicate Pred;
-              if (BI->getSuccessor(0) == Node->getBlock())
-                Pred = ICmpInst::ICMP_EQ;
-              else
-                Pred = ICmpInst::ICMP_NE;
-              if (match(Cond, m_SpecificICmp(
-                                  Pred, m_IRem(m_Specific(X), m_Specific(Y)),
-                                  m_Zero())))
-                return true;
-            }
-          }
-
-          Node = Pred;
-        }
+        for (auto *Cond : GetConditions(X, Y))
+          if ((IsRemZero(Cond, ICmpInst::ICMP_EQ, X, Y) &&
+               DC->isImpliedByBranch(Cond, true, I->getParent())) ||
+              (IsRemZero(Cond, ICmpInst::ICMP_NE, X, Y) &&
+               DC->isImpliedByBranch(Cond, false, I->getParent())))
+            return true;
         return false;
       };
 
@@ -157,6 +139,8 @@ int main(int argc, char **argv) {
         for (auto &I : BB) {
           Value *X, *Y;
           if (match(&I, m_IDiv(m_Value(X), m_Value(Y))) && !I.isExact()) {
+            if (!DC)
+              DC.emplace(F, FA->getDomTree());
             if (IsImpliedByAssumes(&I, X, Y)) {
               ++AssumeCount;
               AssumeSet.insert(Path.string());
@@ -175,6 +159,7 @@ int main(int argc, char **argv) {
     errs() << "\rProgress: " << ++Count;
   }
   errs() << '\n';
+  AnalysisCounters.print(errs());
 
   errs() << "Assume: " << AssumeCount << '\n';
   for (auto &Path : AssumeSet)
@@ -0,0 +1,788 @@
+// SPDX-License-Identifier: MIT License
+// Copyright (c) 2025 Yingwei Zheng
+// This file is licensed under the MIT License.
+// See the LICENSE file for more information.
+
+// A small concrete interpreter for integer-only LLVM IR functions. Each value
+// holds one lane per vector element, or one lane per execution when a scalar
+// function is evaluated over a batch of inputs at once. Poison is tracked per
+// lane and immediate UB is tracked per execution.
+
+#pragma once
+
+#include <llvm/ADT/APInt.h>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/IR/Attributes.h>
+#include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/ConstantRange.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/InstrTypes.h>
+#include <llvm/IR/Instruction.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/Intrinsics.h>
+#include <llvm/IR/Operator.h>
+#include <llvm/IR/Type.h>
+#include <llvm/IR/Value.h>
+#include <llvm/Support/raw_ostream.h>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace llvm {
+
+struct Lane final {
+  APInt Val;
+  bool Poison = false;
+};
+using LaneVector = SmallVector<Lane, 4>;
+
+// Aggregates (e.g. the result of *.with.overflow) keep one LaneVector per
+// struct field. Other values have exactly one field.
+struct LaneValue final {
+  SmallVector<LaneVector, 1> Fields;
+
+  LaneVector &lanes() { return Fields.front(); }
+  const LaneVector &lanes() const { return Fields.front(); }
+};
+
+enum class InterpStatus { Ok, Unsupported, StepLimit };
+
+// Returns true if lane TgtK of Tgt is a refinement of lane SrcK of Src.
+inline bool refines(const LaneValue &Tgt, uint32_t TgtK, const LaneValue &Src,
+                    uint32_t SrcK) {
+  for (uint32_t I = 0, E = Src.Fields.size(); I != E; ++I) {
+    auto &S = Src.Fields[I][SrcK];
+    auto &T = Tgt.Fields[I][TgtK];
+    if (S.Poison)
+      continue;
+    if (T.Poison || T.Val != S.Val)
+      return false;
+  }
+  return true;
+}
+
+inline void printLane(raw_ostream &OS, const Lane &L) {
+  if (L.Poison)
+    OS << "poison";
+  else
+    OS << L.Val;
+}
+
+class LaneInterpreter final {
+  static constexpr uint32_t MaxSteps = 1U << 16;
+
+  Function &F;
+  uint32_t Batch;
+  DenseMap<Value *, uint32_t> SlotMap;
+  DenseMap<BasicBlock *, uint32_t> BlockIdx;
+  std::vector<LaneValue> Slots;
+  SmallVector<bool, 1> UB;
+  SmallVector<uint32_t, 16> Trace;
+  LaneValue Result;
+  bool Supported = true;
+  bool NonDet = false;
+
+  uint32_t getLaneCount(Type *Ty) const {
+    if (auto *VTy = dyn_cast<FixedVectorType>(Ty))
+      return VTy->getNumElements();
+    return Batch;
+  }
+  static bool isSupportedType(Type *Ty) {
+    if (Ty->isVoidTy())
+      return true;
+    if (auto *STy = dyn_cast<StructType>(Ty)) {
+      for (auto *EltTy : STy->elements())
+        if (EltTy->isStructTy() || !isSupportedType(EltTy))
+          return false;
+      return true;
+    }
+    if (isa<ScalableVectorType>(Ty))
+      return false;
+    return Ty->isIntOrIntVectorTy();
+  }
+  // Lanes of a vector-typed value belong to the same execution; lanes of a
+  // scalar value are independent executions in batch mode.
+  void markUB(uint32_t K) { UB[Batch == 1 ? 0 : K] = true; }
+
+  std::optional<Lane> getConstantLane(Constant *C) {
+    if (!C)
+      return std::nullopt;
+    if (isa<PoisonValue>(C))
+      return Lane{APInt::getZero(C->getType()->getScalarSizeInBits()), true};
+    if (auto *CI = dyn_cast<ConstantInt>(C))
+      return Lane{CI->getValue(), false};
+    // undef and constant expressions are not modeled.
+    return std::nullopt;
+  }
+  std::optional<LaneVector> getConstantLanes(Constant *C) {
+    LaneVector Lanes;
+    if (auto *VTy = dyn_cast<FixedVectorType>(C->getType())) {
+      for (uint32_t I = 0, E = VTy->getNumElements(); I != E; ++I) {
+        auto L = getConstantLane(C->getAggregateElement(I));
+        if (!L)
+          return std::nullopt;
+        Lanes.push_back(*L);
+      }
+      return Lanes;
+    }
+    auto L = getConstantLane(C);
+    if (!L)
+      return std::nullopt;
+    Lanes.assign(Batch, *L);
+    return Lanes;
+  }
+  std::optional<LaneValue> getConstant(Constant *C) {
+    LaneValue V;
+    if (auto *STy = dyn_cast<StructType>(C->getType())) {
+      for (uint32_t I = 0, E = STy->getNumElements(); I != E; ++I) {
+        auto *Elt = C->getAggregateElement(I);
+        if (!Elt)
+          return std::nullopt;
+        auto Lanes = getConstantLanes(Elt);
+        if (!Lanes)
+          return std::nullopt;
+        V.Fields.push_back(std::move(*Lanes));
+      }
+      return V;
+    }
+    auto Lanes = getConstantLanes(C);
+    if (!Lanes)
+      return std::nullopt;
+    V.Fields.push_back(std::move(*Lanes));
+    return V;
+  }
+
+  uint32_t addSlot(Value *V) {
+    auto [It, Inserted] = SlotMap.try_emplace(V, Slots.size());
+    if (Inserted)
+      Slots.emplace_back();
+    return It->second;
+  }
+  const LaneValue &get(Value *V) const { return Slots[SlotMap.lookup(V)]; }
+
+  static const Lane &at(const LaneVector &Lanes, uint32_t I) {
+    return Lanes.size() == 1 ? Lanes.front() : Lanes[I];
+  }
+  static uint32_t width(const LaneVector &A, const LaneVector &B) {
+    return std::max(A.size(), B.size());
+  }
+
+  static bool isSupportedIntrinsic(Intrinsic::ID IID) {
+    switch (IID) {
+    case Intrinsic::smin:
+    case Intrinsic::smax:
+    case Intrinsic::umin:
+    case Intrinsic::umax:
+    case Intrinsic::sadd_with_overflow:
+    case Intrinsic::ssub_with_overflow:
+    case Intrinsic::smul_with_overflow:
+    case Intrinsic::uadd_with_overflow:
+    case Intrinsic::usub_with_overflow:
+    case Intrinsic::umul_with_overflow:
+    case Intrinsic::sadd_sat:
+    case Intrinsic::ssub_sat:
+    case Intrinsic::uadd_sat:
+    case Intrinsic::usub_sat:
+    case Intrinsic::scmp:
+    case Intrinsic::ucmp:
+    case Intrinsic::ctpop:
+    case Intrinsic::ctlz:
+    case Intrinsic::cttz:
+    case Intrinsic::abs:
+    case Intrinsic::bswap:
+    case Intrinsic::bitreverse:
+    case Intrinsic::fshl:
+    case Intrinsic::fshr:
+    case Intrinsic::vector_reduce_and:
+    case Intrinsic::vector_reduce_or:
+    case Intrinsic::vector_reduce_xor:
+    case Intrinsic::assume:
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  LaneVector evalBinOp(BinaryOperator &I, const LaneVector &A,
+                       const LaneVector &B) {
+    uint32_t N = width(A, B);
+    LaneVector Res(N);
+    for (uint32_t K = 0; K != N; ++K) {
+      auto &[X, XPoison] = at(A, K);
+      auto &[Y, YPoison] = at(B, K);
+      auto &R = Res[K];
+      R.Val = APInt::getZero(X.getBitWidth());
+      switch (I.getOpcode()) {
+      case Instruction::UDiv:
+      case Instruction::SDiv:
+      case Instruction::URem:
+      case Instruction::SRem: {
+        bool Signed = I.getOpcode() == Instruction::SDiv ||
+                      I.getOpcode() == Instruction::SRem;
+        if (YPoison || Y.isZero() ||
+            (Signed && !XPoison && X.isMinSignedValue() && Y.isAllOnes())) {
+          markUB(K);
+          continue;
+        }
+        if (XPoison) {
+          R.Poison = true;
+          continue;
+        }
+        switch (I.getOpcode()) {
+        case Instruction::UDiv:
+          R.Val = X.udiv(Y);
+          R.Poison = I.isExact() && !X.urem(Y).isZero();
+          break;
+        case Instruction::SDiv:
+          R.Val = X.sdiv(Y);
+          R.Poison = I.isExact() && !X.srem(Y).isZero();
+          break;
+        case Instruction::URem:
+          R.Val = X.urem(Y);
+          break;
+        default:
+          R.Val = X.srem(Y);
+          break;
+        }
+        continue;
+      }
+      default:
+        break;
+      }
+      if (XPoison || YPoison) {
+        R.Poison = true;
+        continue;
+      }
+      bool Overflow = false;
+      switch (I.getOpcode()) {
+      case Instruction::Add:
+        R.Val = X + Y;
+        if (I.hasNoSignedWrap())
+          (void)X.sadd_ov(Y, Overflow);
+        if (!Overflow && I.hasNoUnsignedWrap())
+          (void)X.uadd_ov(Y, Overflow);
+        break;
+      case Instruction::Sub:
+        R.Val = X - Y;
+        if (I.hasNoSignedWrap())
+          (void)X.ssub_ov(Y, Overflow);
+        if (!Overflow && I.hasNoUnsignedWrap())
+          (void)X.usub_ov(Y, Overflow);
+        break;
+      case Instruction::Mul:
+        R.Val = X * Y;
+        if (I.hasNoSignedWrap())
+          (void)X.smul_ov(Y, Overflow);
+        if (!Overflow && I.hasNoUnsignedWrap())
+          (void)X.umul_ov(Y, Overflow);
+        break;
+      case Instruction::Shl:
+        if (Y.uge(X.getBitWidth())) {
+          Overflow = true;
+          break;
+        }
+        R.Val = X.shl(Y);
+        if (I.hasNoSignedWrap())
+          (void)X.sshl_ov(Y, Overflow);
+        if (!Overflow && I.hasNoUnsignedWrap())
+          (void)X.ushl_ov(Y, Overflow);
+        break;
+      case Instruction::LShr:
+      case Instruction::AShr:
+        if (Y.uge(X.getBitWidth())) {
+          Overflow = true;
+          break;
+        }
+        R.Val = I.getOpcode() == Instruction::LShr ? X.lshr(Y) : X.ashr(Y);
+        Overflow = I.isExact() && X.countr_zero() < Y.getZExtValue();
+        break;
+      case Instruction::And:
+        R.Val = X & Y;
+        break;
+      case Instruction::Or:
+        R.Val = X | Y;
+        Overflow = cast<PossiblyDisjointInst>(I).isDisjoint() && X.intersects(Y);
+        break;
+      case Instruction::Xor:
+        R.Val = X ^ Y;
+        break;
+      default:
+        Supported = false;
+        break;
+      }
+      R.Poison = Overflow;
+    }
+    return Res;
+  }
+
+  LaneVector evalCast(CastInst &I, const LaneVector &A) {
+    uint32_t DstBits = I.getDestTy()->getScalarSizeInBits();
+    LaneVector Res(A.size());
+    for (uint32_t K = 0, E = A.size(); K != E; ++K) {
+      auto &[X, XPoison] = A[K];
+      auto &R = Res[K];
+      R.Poison = XPoison;
+      switch (I.getOpcode()) {
+      case Instruction::Trunc: {
+        R.Val = X.trunc(DstBits);
+        auto *TI = cast<TruncInst>(&I);
+        if (TI->hasNoUnsignedWrap() && R.Val.zext(X.getBitWidth()) != X)
+          R.Poison = true;
+        if (TI->hasNoSignedWrap() && R.Val.sext(X.getBitWidth()) != X)
+          R.Poison = true;
+        break;
+      }
+      case Instruction::ZExt:
+        R.Val = X.zext(DstBits);
+        if (I.hasNonNeg() && X.isNegative())
+          R.Poison = true;
+        break;
+      case Instruction::SExt:
+        R.Val = X.sext(DstBits);
+        break;
+      case Instruction::BitCast:
+        if (!I.getSrcTy()->isIntegerTy() || !I.getDestTy()->isIntegerTy()) {
+          Supported = false;
+          return Res;
+        }
+        R.Val = X;
+        break;
+      default:
+        Supported = false;
+        return Res;
+      }
+    }
+    return Res;
+  }
+
+  LaneVector evalICmp(ICmpInst &I, const LaneVector &A, const LaneVector &B) {
+    uint32_t N = width(A, B);
+    LaneVector Res(N);
+    for (uint32_t K = 0; K != N; ++K) {
+      auto &[X, XPoison] = at(A, K);
+      auto &[Y, YPoison] = at(B, K);
+      auto &R = Res[K];
+      R.Val = APInt(1, ICmpInst::compare(X, Y, I.getPredicate()));
+      R.Poison = XPoison || YPoison ||
+                 (I.hasSameSign() && X.isNegative() != Y.isNegative());
+    }
+    return Res;
+  }
+
+  LaneVector evalSelect(const LaneVector &C, const LaneVector &T,
+                        const LaneVector &F) {
+    uint32_t N = std::max<uint32_t>(C.size(), width(T, F));
+    LaneVector Res(N);
+    for (uint32_t K = 0; K != N; ++K) {
+      auto &Cond = at(C, K);
+      auto &Chosen = Cond.Val.isOne() ? at(T, K) : at(F, K);
+      Res[K] = Chosen;
+      if (Cond.Poison)
+        Res[K].Poison = true;
+    }
+    return Res;
+  }
+
+  std::optional<LaneValue> evalIntrinsic(IntrinsicInst &II) {
+    Intrinsic::ID IID = II.getIntrinsicID();
+    LaneValue Res;
+
+    switch (IID) {
+    case Intrinsic::assume: {
+      auto &C = get(II.getArgOperand(0)).lanes();
+      for (uint32_t K = 0, E = C.size(); K != E; ++K)
+        if (C[K].Poison || C[K].Val.isZero())
+          markUB(K);
+      return Res;
+    }
+    case Intrinsic::vector_reduce_and:
+    case Intrinsic::vector_reduce_or:
+    case Intrinsic::vector_reduce_xor: {
+      auto &A = get(II.getArgOperand(0)).lanes();
+      Lane R{A.front().Val, false};
+      for (auto &L : A) {
+        R.Poison |= L.Poison;
+        if (&L == &A.front())
+          continue;
+        if (IID == Intrinsic::vector_reduce_and)
+          R.Val &= L.Val;
+        else if (IID == Intrinsic::vector_reduce_or)
+          R.Val |= L.Val;
+        else
+          R.Val ^= L.Val;
+      }
+      Res.Fields.push_back(LaneVector{R});
+      return Res;
+    }
+    default:
+      break;
+    }
+
+    bool IsWithOverflow = isa<WithOverflowInst>(II);
+    uint32_t N = 1;
+    for (Value *Arg : II.args())
+      N = std::max<uint32_t>(N, get(Arg).lanes().size());
+    Res.Fields.resize(IsWithOverflow ? 2 : 1);
+    for (auto &Field : Res.Fields)
+      Field.resize(N);
+    uint32_t RetBits = II.getType()->getScalarSizeInBits();
+    if (IsWithOverflow)
+      RetBits = II.getArgOperand(0)->getType()->getScalarSizeInBits();
+
+    for (uint32_t K = 0; K != N; ++K) {
+      SmallVector<const Lane *, 3> Ops;
+      bool AnyPoison = false;
+      for (Value *Arg : II.args()) {
+        Ops.push_back(&at(get(Arg).lanes(), K));
+        AnyPoison |= Ops.back()->Poison;
+      }
+      auto &R = Res.Fields[0][K];
+      R.Val = APInt::getZero(RetBits);
+      if (IsWithOverflow)
+        Res.Fields[1][K].Val = APInt::getZero(1);
+      if (AnyPoison) {
+        for (auto &Field : Res.Fields)
+          Field[K].Poison = true;
+        continue;
+      }
+      const APInt &X = Ops[0]->Val;
+      bool Overflow = false;
+      switch (IID) {
+      case Intrinsic::smin:
+        R.Val = APIntOps::smin(X, Ops[1]->Val);
+        break;
+      case Intrinsic::smax:
+        R.Val = APIntOps::smax(X, Ops[1]->Val);
+        break;
+      case Intrinsic::umin:
+        R.Val = APIntOps::umin(X, Ops[1]->Val);
+        break;
+      case Intrinsic::umax:
+        R.Val = APIntOps::umax(X, Ops[1]->Val);
+        break;
+      case Intrinsic::sadd_with_overflow:
+        R.Val = X.sadd_ov(Ops[1]->Val, Overflow);
+        break;
+      case Intrinsic::ssub_with_overflow:
+        R.Val = X.ssub_ov(Ops[1]->Val, Overflow);
+        break;
+      case Intrinsic::smul_with_overflow:
+        R.Val = X.smul_ov(Ops[1]->Val, Overflow);
+        break;
+      case Intrinsic::uadd_with_overflow:
+        R.Val = X.uadd_ov(Ops[1]->Val, Overflow);
+        break;
+      case Intrinsic::usub_with_overflow:
+        R.Val = X.usub_ov(Ops[1]->Val, Overflow);
+        break;
+      case Intrinsic::umul_with_overflow:
+        R.Val = X.umul_ov(Ops[1]->Val, Overflow);
+        break;
+      case Intrinsic::sadd_sat:
+        R.Val = X.sadd_sat(Ops[1]->Val);
+        break;
+      case Intrinsic::ssub_sat:
+        R.Val = X.ssub_sat(Ops[1]->Val);
+        break;
+      case Intrinsic::uadd_sat:
+        R.Val = X.uadd_sat(Ops[1]->Val);
+        break;
+      case Intrinsic::usub_sat:
+        R.Val = X.usub_sat(Ops[1]->Val);
+        break;
+      case Intrinsic::scmp:
+      case Intrinsic::ucmp: {
+        const APInt &Y = Ops[1]->Val;
+        bool Signed = IID == Intrinsic::scmp;
+        bool LT = Signed ? X.slt(Y) : X.ult(Y);
+        bool GT = Signed ? X.sgt(Y) : X.ugt(Y);
+        R.Val = APInt(RetBits, LT ? -1 : (GT ? 1 : 0), /*isSigned=*/true);
+        break;
+      }
+      case Intrinsic::ctpop:
+        R.Val = APInt(RetBits, X.popcount());
+        break;
+      case Intrinsic::ctlz:
+      case Intrinsic::cttz:
+        R.Val = APInt(RetBits,
+                      IID == Intrinsic::ctlz ? X.countl_zero() : X.countr_zero());
+        R.Poison = X.isZero() && Ops[1]->Val.isOne();
+        break;
+      case Intrinsic::abs:
+        R.Val = X.abs();
+        R.Poison = X.isMinSignedValue() && Ops[1]->Val.isOne();
+        break;
+      case Intrinsic::bswap:
+        R.Val = X.byteSwap();
+        break;
+      case Intrinsic::bitreverse:
+        R.Val = X.reverseBits();
+        break;
+      case Intrinsic::fshl:
+      case Intrinsic::fshr: {
+        const APInt &Y = Ops[1]->Val;
+        uint32_t BW = X.getBitWidth();
+        uint32_t Amt = Ops[2]->Val.urem(APInt(BW, BW)).getZExtValue();
+        if (Amt == 0)
+          R.Val = IID == Intrinsic::fshl ? X : Y;
+        else if (IID == Intrinsic::fshl)
+          R.Val = X.shl(Amt) | Y.lshr(BW - Amt);
+        else
+          R.Val = X.shl(BW - Amt) | Y.lshr(Amt);
+        break;
+      }
+      default:
+        return std::nullopt;
+      }
+      if (IsWithOverflow)
+        Res.Fields[1][K].Val = APInt(1, Overflow);
+    }
+    return Res;
+  }
+
+  // Apply range/noundef return attributes of a call or a function.
+  void applyRetAttrs(LaneVector &Lanes, std::optional<ConstantRange> Range,
+                     bool NoUndef) {
+    for (uint32_t K = 0, E = Lanes.size(); K != E; ++K) {
+      auto &L = Lanes[K];
+      if (Range && !L.Poison && !Range->contains(L.Val))
+        L.Poison = true;
+      if (NoUndef && L.Poison)
+        markUB(K);
+    }
+  }
+
+  std::optional<LaneValue> evalInst(Instruction &I) {
+    LaneValue Res;
+    if (auto *BO = dyn_cast<BinaryOperator>(&I)) {
+      Res.Fields.push_back(evalBinOp(*BO, get(I.getOperand(0)).lanes(),
+                                     get(I.getOperand(1)).lanes()));
+      return Res;
+    }
+    if (auto *Cast = dyn_cast<CastInst>(&I)) {
+      Res.Fields.push_back(evalCast(*Cast, get(I.getOperand(0)).lanes()));
+      return Res;
+    }
+    if (auto *ICmp = dyn_cast<ICmpInst>(&I)) {
+      Res.Fields.push_back(evalICmp(*ICmp, get(I.getOperand(0)).lanes(),
+                                    get(I.getOperand(1)).lanes()));
+      return Res;
+    }
+    if (auto *Sel = dyn_cast<SelectInst>(&I)) {
+      auto &C = get(Sel->getCondition()).lanes();
+      auto &T = get(Sel->getTrueValue());
+      auto &F = get(Sel->getFalseValue());
+      for (uint32_t Idx = 0, E = T.Fields.size(); Idx != E; ++Idx)
+        Res.Fields.push_back(evalSelect(C, T.Fields[Idx], F.Fields[Idx]));
+      return Res;
+    }
+    if (isa<FreezeInst>(&I)) {
+      Res = get(I.getOperand(0));
+      for (auto &Field : Res.Fields)
+        for (auto &L : Field)
+          if (L.Poison) {
+            // Any value is a valid choice; callers that need to reason about
+            // it check hasNonDeterminism().
+            L = Lane{APInt::getZero(L.Val.getBitWidth()), false};
+            NonDet = true;
+          }
+      return Res;
+    }
+    if (auto *EV = dyn_cast<ExtractValueInst>(&I)) {
+      if (EV->getNumIndices() != 1)
+        return std::nullopt;
+      Res.Fields.push_back(
+          get(EV->getAggregateOperand()).Fields[EV->getIndices()[0]]);
+      return Res;
+    }
+    if (auto *II = dyn_cast<IntrinsicInst>(&I)) {
+      if (!isSupportedIntrinsic(II->getIntrinsicID()))
+        return std::nullopt;
+      for (uint32_t Idx = 0, E = II->arg_size(); Idx != E; ++Idx)
+        if (II->paramHasAttr(Idx, Attribute::NoUndef))
+          for (auto &Field : get(II->getArgOperand(Idx)).Fields)
+            for (uint32_t K = 0, E2 = Field.size(); K != E2; ++K)
+              if (Field[K].Poison)
+                markUB(K);
+      auto V = evalIntrinsic(*II);
+      if (!V)
+        return std::nullopt;
+      if (!II->getType()->isVoidTy() && !II->getType()->isStructTy())
+        applyRetAttrs(V->lanes(), II->getRange(),
+                      II->hasRetAttr(Attribute::NoUndef));
+      return V;
+    }
+    return std::nullopt;
+  }
+
+public:
+  explicit LaneInterpreter(Function &Fn, uint32_t BatchSize = 1)
+      : F(Fn), Batch(BatchSize) {
+    if (!isSupportedType(F.getReturnType()))
+      Supported = false;
+    for (auto &Arg : F.args()) {
+      addSlot(&Arg);
+      if (!isSupportedType(Arg.getType()))
+        Supported = false;
+    }
+    for (auto &BB : F) {
+      uint32_t Idx = BlockIdx.size();
+      BlockIdx[&BB] = Idx;
+      for (auto &I : BB) {
+        if (!isSupportedType(I.getType()))
+          Supported = false;
+        if (I.isTerminator() && !isa<BranchInst, ReturnInst, UnreachableInst>(I))
+          Supported = false;
+        if (auto *II = dyn_cast<IntrinsicInst>(&I)) {
+          if (!isSupportedIntrinsic(II->getIntrinsicID()))
+            Supported = false;
+        } else if (isa<CallBase>(I) || I.mayReadOrWriteMemory())
+          Supported = false;
+        if (!I.getType()->isVoidTy())
+          addSlot(&I);
+        for (Value *Op : I.operands()) {
+          auto *C = dyn_cast<Constant>(Op);
+          if (!C || isa<Function>(C) || SlotMap.contains(C))
+            continue;
+          if (!isSupportedType(C->getType())) {
+            Supported = false;
+            continue;
+          }
+          auto V = getConstant(C);
+          if (!V) {
+            Supported = false;
+            continue;
+          }
+          Slots[addSlot(C)] = std::move(*V);
+        }
+      }
+    }
+  }
+
+  bool isSupported() const { return Supported; }
+  uint32_t getBatchSize() const { return Batch; }
+  // Returns the number of lanes that an argument of type Ty is expected to
+  // carry.
+  uint32_t getArgLaneCount(Type *Ty) const { return getLaneCount(Ty); }
+
+  InterpStatus run(ArrayRef<LaneValue> Args) {
+    if (!Supported)
+      return InterpStatus::Unsupported;
+    UB.assign(Batch, false);
+    Trace.clear();
+    Result = LaneValue{};
+    NonDet = false;
+
+    for (auto &Arg : F.args()) {
+      auto &Slot = Slots[SlotMap.lookup(&Arg)];
+      Slot = Args[Arg.getArgNo()];
+      if (Arg.getType()->isStructTy())
+        continue;
+      auto &Lanes = Slot.lanes();
+      for (uint32_t K = 0, E = Lanes.size(); K != E; ++K) {
+        auto &L = Lanes[K];
+        if (!L.Poison)
+          if (auto Range = Arg.getRange(); Range && !Range->contains(L.Val))
+            L.Poison = true;
+        if (L.Poison && Arg.hasNoUndefAttr())
+          markUB(K);
+      }
+    }
+
+    auto AllUB = [&] {
+      for (bool B : UB)
+        if (!B)
+          return false;
+      return true;
+    };
+
+    BasicBlock *Prev = nullptr;
+    BasicBlock *BB = &F.getEntryBlock();
+    uint32_t Steps = 0;
+    while (true) {
+      Trace.push_back(BlockIdx.lookup(BB));
+      // PHIs are evaluated simultaneously.
+      SmallVector<std::pair<uint32_t, LaneValue>, 4> PHIValues;
+      for (auto &PHI : BB->phis())
+        PHIValues.emplace_back(SlotMap.lookup(&PHI),
+                               get(PHI.getIncomingValueForBlock(Prev)));
+      for (auto &[Slot, V] : PHIValues)
+        Slots[Slot] = std::move(V);
+
+      for (auto &I : make_range(BB->getFirstNonPHIIt(), BB->end())) {
+        if (++Steps > MaxSteps)
+          return InterpStatus::StepLimit;
+
+        if (auto *Ret = dyn_cast<ReturnInst>(&I)) {
+          if (Value *RetV = Ret->getReturnValue()) {
+            Result = get(RetV);
+            if (!RetV->getType()->isStructTy()) {
+              auto RetAttrs = F.getAttributes().getRetAttrs();
+              std::optional<ConstantRange> Range;
+              if (RetAttrs.hasAttribute(Attribute::Range))
+                Range = RetAttrs.getAttribute(Attribute::Range).getRange();
+              applyRetAttrs(Result.lanes(), Range,
+                            RetAttrs.hasAttribute(Attribute::NoUndef));
+            }
+          }
+          return InterpStatus::Ok;
+        }
+        if (isa<UnreachableInst>(&I)) {
+          UB.assign(Batch, true);
+          return InterpStatus::Ok;
+        }
+        if (auto *Br = dyn_cast<BranchInst>(&I)) {
+          BasicBlock *Next = Br->getSuccessor(0);
+          if (Br->isConditional()) {
+            // All live executions have to agree on the branch direction.
+            auto &C = get(Br->getCondition()).lanes();
+            std::optional<bool> Taken;
+            for (uint32_t K = 0, E = C.size(); K != E; ++K) {
+              if (UB[Batch == 1 ? 0 : K])
+                continue;
+              if (C[K].Poison) {
+                markUB(K);
+                continue;
+              }
+              bool Dir = C[K].Val.isOne();
+              if (Taken && *Taken != Dir)
+                return InterpStatus::Unsupported;
+              Taken = Dir;
+            }
+            if (!Taken)
+              return InterpStatus::Ok;
+            Next = Br->getSuccessor(*Taken ? 0 : 1);
+          }
+          Prev = BB;
+          BB = Next;
+          break;
+        }
+        if (I.isTerminator())
+          return InterpStatus::Unsupported;
+
+        auto V = evalInst(I);
+        if (!V || !Supported)
+          return InterpStatus::Unsupported;
+        if (!I.getType()->isVoidTy())
+          Slots[SlotMap.lookup(&I)] = std::move(*V);
+        if (Batch == 1 && UB.front())
+          return InterpStatus::Ok;
+        if (AllUB())
+          return InterpStatus::Ok;
+      }
+    }
+  }
+
+  const LaneValue &getResult() const { return Result; }
+  bool isUB(uint32_t Exec = 0) const { return UB[Exec]; }
+  // Set if a freeze instruction had to pick a value for a poison lane.
+  bool hasNonDeterminism() const { return NonDet; }
+  ArrayRef<uint32_t> getTrace() const { return Trace; }
+};
+
+} // namespace llvm
@@ -34,13 +34,17 @@
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/ToolOutputFile.h>
 #include <llvm/Support/raw_ostream.h>
+#include "function-analyses.h"
+#include "string-cache.h"
 #include <llvm/TargetParser/Triple.h>
 #include <cstdint>
 #include <cstdlib>
 #include <filesystem>
 #include <map>
 #include <memory>
+#include <string>
 #include <unordered_map>
+#include <vector>
 
 using namespace llvm;
 namespace fs = std::filesystem;
@@ -49,6 +53,95 @@ static cl::opt<std::string>
     InputDir(cl::Positional, cl::desc("<directory for input LLVM IR files>"),
              cl::Required, cl::value_desc("inputdir"));
 
+static cl::opt<std::string>
+    ProfileFile("profile",
+                cl::desc("Write a per-LibFunc usage profile to this file"),
+                cl::value_desc("file"));
+
+enum FreqClass { Cold, Normal, Hot, NumFreqClasses };
+static const char *FreqClassNames[] = {"cold", "normal", "hot"};
+
+// Call sites at least 8x less (more) frequent than the function entry are
+// cold (hot).
+static FreqClass getFreqClass(BlockFrequencyInfo &BFI, const BasicBlock *BB) {
+  uint64_t Entry =
+      BFI.getBlockFreq(&BB->getParent()->getEntryBlock()).getFrequency();
+  uint64_t Freq = BFI.getBlockFreq(BB).getFrequency();
+  if (Freq < Entry / 8)
+    return Cold;
+  if (Freq / 8 >= Entry)
+    return Hot;
+  return Normal;
+}
+
+struct ArgProfile final {
+  uint64_t Const = 0;
+  uint64_t NonConst = 0;
+  // Values of constant integer arguments (sizes, lengths, characters).
+  std::map<uint64_t, uint64_t> Values;
+};
+
+struct LibFuncProfile final {
+  uint64_t Calls = 0;
+  std::vector<ArgProfile> Args;
+  uint64_t Freq[NumFreqClasses] = {};
+  // Calls with at least one constant string argument.
+  uint64_t ConstStringCalls = 0;
+};
+
+// Keyed by the canonical LibFunc name, so the output is sorted and stable.
+static std::map<std::string, LibFuncProfile> Profiles;
+
+static void profileCall(CallInst &Call, StringRef Name,
+                        FunctionAnalyses &FA, ConstantStringCache &Strings) {
+  auto &P = Profiles[Name.str()];
+  ++P.Calls;
+  if (P.Args.size() < Call.arg_size())
+    P.Args.resize(Call.arg_size());
+  bool HasConstString = false;
+  for (uint32_t Idx = 0; Idx != Call.arg_size(); ++Idx) {
+    Value *Arg = Call.getArgOperand(Idx);
+    auto &A = P.Args[Idx];
+    if (!isa<Constant>(Arg)) {
+      ++A.NonConst;
+      continue;
+    }
+    ++A.Const;
+    if (auto *CI = dyn_cast<ConstantInt>(Arg); CI && CI->getBitWidth() <= 64)
+      ++A.Values[CI->getZExtValue()];
+    HasConstString |= Strings.lookup(Arg).has_value();
+  }
+  P.ConstStringCalls += HasConstString;
+  ++P.Freq[getFreqClass(FA.getBFI(), Call.getParent())];
+}
+
+// One record per line so that profiles of two corpus revisions can be
+// compared with diff.
+static bool writeProfile() {
+  std::error_code EC;
+  ToolOutputFile Out(ProfileFile, EC, sys::fs::OF_None);
+  if (EC) {
+    errs() << ProfileFile << ": " << EC.message() << '\n';
+    return false;
+  }
+  auto &OS = Out.os();
+  for (auto &[Name, P] : Profiles) {
+    OS << Name << " calls " << P.Calls << '\n';
+    OS << Name << " const-string " << P.ConstStringCalls << '\n';
+    for (uint32_t K = 0; K != NumFreqClasses; ++K)
+      OS << Name << " freq " << FreqClassNames[K] << ' ' << P.Freq[K] << '\n';
+    for (uint32_t Idx = 0; Idx != P.Args.size(); ++Idx) {
+      auto &A = P.Args[Idx];
+      OS << Name << " arg" << Idx << " const " << A.Const << " nonconst "
+         << A.NonConst << '\n';
+      for (auto [V, Count] : A.Values)
+        OS << Name << " arg" << Idx << " value " << V << ' ' << Count << '\n';
+    }
+  }
+  Out.keep();
+  return true;
+}
+
 int main(int argc, char **argv) {
   InitLLVM Init{argc, argv};
   cl::ParseCommandLineOptions(argc, argv, "scanner\n");
@@ -77,6 +170,8 @@ int main(int argc, char **argv) {
   LLVMContext Context;
   uint32_t Count = 0;
   StringMap<uint32_t> CallDist;
+  // Calls with at least one constant string argument.
+  StringMap<uint32_t> StrArgDist;
 
   for (auto &Path : InputFiles) {
     SMDiagnostic Err;
@@ -84,12 +179,15 @@ int main(int argc, char **argv) {
     if (!M)
       continue;
 
-    TargetLibraryInfoImpl TLIImpl(Triple(M->getTargetTriple()));
+    ModuleAnalyses MA{*M};
+    ConstantStringCache Strings{*M};
 
     for (auto &F : *M) {
-      if (F.empty())
+      auto *FA = MA.getIf(
+          F, [](const InstSummary &S) { return S.has(Instruction::Call); });
+      if (!FA)
         continue;
-      TargetLibraryInfo TLI(TLIImpl, &F);
+      auto &TLI = FA->getTLI();
 
       for (auto &BB : F) {
         for (auto &I : BB) {
@@ -101,6 +199,11 @@ int main(int argc, char **argv) {
             LibFunc LibCall;
             if (TLI.getLibFunc(*Call, LibCall)) {
               CallDist[Callee->getName()]++;
+              if (!ProfileFile.empty())
+                profileCall(*Call, TLI.getName(LibCall), *FA, Strings);
+              if (any_of(Call->args(),
+                         [&](Value *Arg) { return Strings.lookup(Arg); }))
+                StrArgDist[Callee->getName()]++;
             }
           }
         }
@@ -112,7 +215,11 @@ int main(int argc, char **argv) {
   errs() << '\n';
 
   for (auto &K : CallDist)
-    errs() << K.first() << ' ' << K.second << '\n';
+    errs() << K.first() << ' ' << K.second << ' '
+           << StrArgDist.lookup(K.first()) << '\n';
+
+  if (!ProfileFile.empty() && !writeProfile())
+    return EXIT_FAILURE;
 
   return EXIT_SUCCESS;
 }
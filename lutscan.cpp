@@ -4,6 +4,7 @@
 // See the LICENSE file for more information.
 
 #include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/MapVector.h>
 #include <llvm/Analysis/ConstantFolding.h>
 #include <llvm/Analysis/LoopInfo.h>
 #include <llvm/IR/BasicBlock.h>
@@ -33,18 +34,26 @@
 #include <llvm/Support/Error.h>
 #include <llvm/Support/ErrorHandling.h>
 #include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Format.h>
 #include <llvm/Support/FormattedStream.h>
 #include <llvm/Support/InitLLVM.h>
+#include <llvm/Support/MathExtras.h>
 #include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/ToolOutputFile.h>
 #include <llvm/Support/raw_ostream.h>
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <filesystem>
 #include <map>
 #include <memory>
+#include <optional>
 #include <set>
+#include <tuple>
+#include <vector>
 
 using namespace llvm;
 using namespace PatternMatch;
@@ -54,8 +63,473 @@ static cl::opt<std::string>
     InputDir(cl::Positional, cl::desc("<directory for input LLVM IR files>"),
              cl::Required, cl::value_desc("inputdir"));
 
-std::map<uint64_t, uint32_t> Cost;
-std::map<uint64_t, uint32_t> Distrib;
+static cl::opt<bool>
+    Bench("bench", cl::desc("Time every table scan with both the raw-data fast "
+                            "path and the generic path and report tables/s"),
+          cl::init(false));
+
+static cl::list<std::string> Classifiers(
+    "classifiers",
+    cl::desc("Table classifiers to evaluate (default: all of two-values, "
+             "small-range, linear, bitmask)"),
+    cl::CommaSeparated, cl::value_desc("name"));
+
+static cl::opt<std::string>
+    ReportFile("report",
+               cl::desc("CSV file for the per-classifier histograms"),
+               cl::init("-"), cl::value_desc("file"));
+
+// One table element as seen by the classifiers. Integers up to 64 bits are
+// zero-extended and FP values are stored as their bits; any other constant
+// gets an identity number, so equal elements always compare equal.
+struct TableElt final {
+  enum EltKind : uint8_t { Int, FP, Opaque };
+  uint64_t Bits;
+  EltKind Kind;
+
+  bool operator==(const TableElt &RHS) const {
+    return Bits == RHS.Bits && Kind == RHS.Kind;
+  }
+  bool operator!=(const TableElt &RHS) const { return !(*this == RHS); }
+};
+
+struct TableInfo final {
+  // Width of integer elements, 0 for other element types.
+  uint32_t BitWidth;
+  // Number of loads it takes to walk the table at the given stride.
+  uint64_t NumElts;
+};
+
+struct ClassifierResult final {
+  bool Accepted = false;
+  // Number of elements the classifier consumed before it decided. This is
+  // what the corresponding InstCombine fold would pay per load.
+  uint32_t Scanned = 0;
+
+  bool operator==(const ClassifierResult &RHS) const {
+    return Accepted == RHS.Accepted && Scanned == RHS.Scanned;
+  }
+};
+
+// A candidate LUT fold. All classifiers are driven by a single scan over the
+// table; each one drops out as soon as the table cannot be folded its way.
+class TableClassifier {
+public:
+  virtual ~TableClassifier() = default;
+  virtual StringRef getName() const = 0;
+  // Returns false if the table is rejected before looking at any element.
+  virtual bool start(const TableInfo &T) = 0;
+  // Returns false once the table is rejected.
+  virtual bool visit(uint64_t I, TableElt Elt) = 0;
+  // Called after the last element unless visit returned false.
+  virtual bool finish() { return true; }
+  // Optional fast path over the raw bytes of a ConstantDataArray.
+  virtual std::optional<ClassifierResult>
+  classifyRaw(const ConstantDataArray *CDA, uint64_t Stride) {
+    return std::nullopt;
+  }
+};
+
+// At most two distinct values, one of which occurs only once, so the load
+// folds to a select on the index.
+template <typename T>
+static ClassifierResult scanRawTwoValues(const ConstantDataArray *CDA,
+                                         uint64_t Stride);
+
+class TwoValuesClassifier final : public TableClassifier {
+  TableElt V0, V1;
+  bool HasV1;
+  uint64_t C0, C1;
+
+public:
+  StringRef getName() const override { return "two-values"; }
+  bool start(const TableInfo &T) override {
+    HasV1 = false;
+    C0 = C1 = 0;
+    return true;
+  }
+  bool visit(uint64_t I, TableElt Elt) override {
+    if (I == 0)
+      V0 = Elt;
+    if (Elt == V0)
+      ++C0;
+    else if (HasV1 && Elt == V1)
+      ++C1;
+    else if (!HasV1) {
+      HasV1 = true;
+      V1 = Elt;
+      C1 = 1;
+      return true;
+    } else
+      return false;
+    return C0 < 2 || C1 < 2;
+  }
+  std::optional<ClassifierResult> classifyRaw(const ConstantDataArray *CDA,
+                                              uint64_t Stride) override {
+    switch (CDA->getElementByteSize()) {
+    case 1:
+      return scanRawTwoValues<uint8_t>(CDA, Stride);
+    case 2:
+      return scanRawTwoValues<uint16_t>(CDA, Stride);
+    case 4:
+      return scanRawTwoValues<uint32_t>(CDA, Stride);
+    case 8:
+      return scanRawTwoValues<uint64_t>(CDA, Stride);
+    default:
+      return std::nullopt;
+    }
+  }
+};
+
+// Integer elements whose range fits in a byte, so the table can be narrowed
+// to i8 offsets from the minimum. The range is tracked both unsigned and
+// signed, so tables like {-1, 0, 1} qualify too.
+class SmallRangeClassifier final : public TableClassifier {
+  uint32_t BitWidth;
+  uint64_t UMin, UMax;
+  int64_t SMin, SMax;
+
+public:
+  StringRef getName() const override { return "small-range"; }
+  bool start(const TableInfo &T) override {
+    BitWidth = T.BitWidth;
+    UMin = UINT64_MAX;
+    UMax = 0;
+    SMin = INT64_MAX;
+    SMax = INT64_MIN;
+    return T.BitWidth > 8 && T.BitWidth <= 64;
+  }
+  bool visit(uint64_t I, TableElt Elt) override {
+    if (Elt.Kind != TableElt::Int)
+      return false;
+    UMin = std::min(UMin, Elt.Bits);
+    UMax = std::max(UMax, Elt.Bits);
+    int64_t S = SignExtend64(Elt.Bits, BitWidth);
+    SMin = std::min(SMin, S);
+    SMax = std::max(SMax, S);
+    return UMax - UMin < 256 || uint64_t(SMax) - uint64_t(SMin) < 256;
+  }
+};
+
+// Elements of the form a * i + b (modulo 2^BitWidth), so the load folds to
+// arithmetic on the index.
+class LinearClassifier final : public TableClassifier {
+  uint64_t Mask, B, A;
+
+public:
+  StringRef getName() const override { return "linear"; }
+  bool start(const TableInfo &T) override {
+    if (T.BitWidth == 0 || T.BitWidth > 64)
+      return false;
+    Mask = maskTrailingOnes<uint64_t>(T.BitWidth);
+    A = B = 0;
+    return true;
+  }
+  bool visit(uint64_t I, TableElt Elt) override {
+    if (Elt.Kind != TableElt::Int)
+      return false;
+    if (I == 0)
+      B = Elt.Bits;
+    else if (I == 1)
+      A = (Elt.Bits - B) & Mask;
+    return ((A * I + B) & Mask) == Elt.Bits || I == 0;
+  }
+};
+
+// At most two distinct values in a table of up to 64 entries, so the load
+// folds to a test of bit i in a constant mask.
+class BitmaskClassifier final : public TableClassifier {
+  TableElt V0, V1;
+  bool HasV1;
+
+public:
+  StringRef getName() const override { return "bitmask"; }
+  bool start(const TableInfo &T) override {
+    HasV1 = false;
+    return T.NumElts <= 64;
+  }
+  bool visit(uint64_t I, TableElt Elt) override {
+    if (I == 0)
+      V0 = Elt;
+    if (Elt == V0 || (HasV1 && Elt == V1))
+      return true;
+    if (HasV1)
+      return false;
+    HasV1 = true;
+    V1 = Elt;
+    return true;
+  }
+};
+
+static std::vector<std::unique_ptr<TableClassifier>> AllClassifiers;
+
+static void registerClassifiers() {
+  std::vector<std::unique_ptr<TableClassifier>> Available;
+  Available.push_back(std::make_unique<TwoValuesClassifier>());
+  Available.push_back(std::make_unique<SmallRangeClassifier>());
+  Available.push_back(std::make_unique<LinearClassifier>());
+  Available.push_back(std::make_unique<BitmaskClassifier>());
+  for (auto &C : Available)
+    if (Classifiers.empty() || is_contained(Classifiers, C->getName()))
+      AllClassifiers.push_back(std::move(C));
+}
+
+// Histogram bucket B holds tables of (2^(B-1), 2^B] bytes.
+struct BucketStats final {
+  uint64_t Loads = 0;
+  uint64_t Folds = 0;
+  // Elements scanned, including the scans answered from ScanCache, since
+  // InstCombine itself does not memoize.
+  uint64_t Cost = 0;
+};
+static std::vector<std::map<uint32_t, BucketStats>> Histograms;
+static uint64_t MaxArraySize = 0;
+// Elements visited by the shared scan, and visits saved by ScanCache.
+static uint64_t ScanDone = 0, ScanAvoided = 0;
+
+struct LUTScanResult final {
+  SmallVector<ClassifierResult, 4> Results;
+  // Elements visited by the longest scan, raw or shared.
+  uint32_t Visited = 0;
+
+  bool operator==(const LUTScanResult &RHS) const {
+    return Results == RHS.Results;
+  }
+};
+
+// The scan only depends on the initializer, the load type and the stride, so
+// loads from the same table share the result. Cleared for each module.
+static DenseMap<std::tuple<GlobalVariable *, Type *, uint64_t>, LUTScanResult>
+    ScanCache;
+
+// Same state machine as TwoValuesClassifier, but over the raw element bytes
+// of a ConstantDataArray. Blocks of elements that cannot change the state
+// (every element is one of the values seen so far and the repeat counts stay
+// below the bail-out point) are handled by branch-free counting loops that
+// the compiler vectorizes; only the block where something happens is
+// replayed element by element.
+template <typename T>
+static ClassifierResult scanRawTwoValues(const ConstantDataArray *CDA,
+                                         uint64_t Stride) {
+  constexpr uint64_t Block = 64;
+  const char *Raw = CDA->getRawDataValues().data();
+  auto LoadElt = [&](uint64_t I) {
+    T V;
+    std::memcpy(&V, Raw + I * Stride * sizeof(T), sizeof(T));
+    return V;
+  };
+  uint64_t N = (CDA->getNumElements() + Stride - 1) / Stride;
+
+  ClassifierResult Res;
+  T V0 = LoadElt(0);
+  T V1 = V0;
+  bool HasV1 = false;
+  uint64_t C0 = 0, C1 = 0;
+  for (uint64_t I = 0; I < N;) {
+    uint64_t E = std::min(N, I + Block);
+    uint32_t Eq0 = 0, Eq1 = 0;
+    for (uint64_t K = I; K < E; ++K) {
+      T V = LoadElt(K);
+      Eq0 += V == V0;
+      Eq1 += V == V1;
+    }
+    bool Unchanged = HasV1 ? Eq0 + Eq1 == E - I &&
+                                 !(C0 + Eq0 >= 2 && C1 + Eq1 >= 2)
+                           : Eq0 == E - I;
+    if (Unchanged) {
+      C0 += Eq0;
+      C1 += HasV1 ? Eq1 : 0;
+      I = E;
+      continue;
+    }
+    for (; I < E; ++I) {
+      T V = LoadElt(I);
+      if (V == V0)
+        ++C0;
+      else if (HasV1 && V == V1)
+        ++C1;
+      else if (!HasV1) {
+        HasV1 = true;
+        V1 = V;
+        C1 = 1;
+        continue;
+      } else {
+        Res.Scanned = I + 1;
+        return Res;
+      }
+      if (C0 >= 2 && C1 >= 2) {
+        Res.Scanned = I + 1;
+        return Res;
+      }
+    }
+  }
+  Res.Accepted = true;
+  Res.Scanned = N;
+  return Res;
+}
+
+// Feeds the elements produced by GetElt to every classifier that is still
+// undecided. GetElt returns std::nullopt for elements that block all folds.
+template <typename EltFn>
+static uint32_t runClassifiers(const TableInfo &T,
+                               SmallVectorImpl<ClassifierResult> &Results,
+                               SmallVectorImpl<uint32_t> &Pending,
+                               EltFn GetElt) {
+  SmallVector<uint32_t, 4> Live;
+  for (auto Idx : Pending)
+    if (AllClassifiers[Idx]->start(T))
+      Live.push_back(Idx);
+  uint32_t Visited = 0;
+  for (uint64_t I = 0; I < T.NumElts && !Live.empty(); ++I) {
+    ++Visited;
+    std::optional<TableElt> Elt = GetElt(I);
+    for (auto &Idx : Live) {
+      ++Results[Idx].Scanned;
+      if (!Elt || !AllClassifiers[Idx]->visit(I, *Elt))
+        Idx = UINT32_MAX;
+    }
+    Live.erase(std::remove(Live.begin(), Live.end(), UINT32_MAX), Live.end());
+  }
+  for (auto Idx : Live)
+    Results[Idx].Accepted = AllClassifiers[Idx]->finish();
+  return Visited;
+}
+
+// The raw data of a ConstantDataArray has no alignment guarantee.
+template <typename T> static uint64_t readRawElt(const char *P) {
+  T V;
+  std::memcpy(&V, P, sizeof(T));
+  return V;
+}
+
+// Returns std::nullopt if the load does not read whole elements of a
+// ConstantDataArray at a stride that is a multiple of the element size.
+static std::optional<LUTScanResult>
+scanRawLUT(Constant *Init, Type *LoadTy, const APInt &Step) {
+  auto *CDA = dyn_cast<ConstantDataArray>(Init);
+  if (!CDA || CDA->getElementType() != LoadTy || CDA->getNumElements() == 0)
+    return std::nullopt;
+  uint64_t EltSize = CDA->getElementByteSize();
+  if (Step.getLimitedValue() % EltSize != 0 || EltSize > 8)
+    return std::nullopt;
+  uint64_t Stride = Step.getLimitedValue() / EltSize;
+
+  LUTScanResult Res;
+  Res.Results.resize(AllClassifiers.size());
+  SmallVector<uint32_t, 4> Pending;
+  for (uint32_t Idx = 0; Idx != AllClassifiers.size(); ++Idx) {
+    if (auto R = AllClassifiers[Idx]->classifyRaw(CDA, Stride)) {
+      Res.Results[Idx] = *R;
+      Res.Visited = std::max(Res.Visited, R->Scanned);
+    } else
+      Pending.push_back(Idx);
+  }
+  if (Pending.empty())
+    return Res;
+
+  StringRef Raw = CDA->getRawDataValues();
+  bool IsInt = LoadTy->isIntegerTy();
+  TableInfo T{IsInt ? LoadTy->getIntegerBitWidth() : 0,
+              (CDA->getNumElements() + Stride - 1) / Stride};
+  uint32_t Shared = runClassifiers(
+      T, Res.Results, Pending, [&](uint64_t I) -> std::optional<TableElt> {
+        const char *P = Raw.data() + I * Stride * EltSize;
+        uint64_t Bits;
+        switch (EltSize) {
+        case 1:
+          Bits = readRawElt<uint8_t>(P);
+          break;
+        case 2:
+          Bits = readRawElt<uint16_t>(P);
+          break;
+        case 4:
+          Bits = readRawElt<uint32_t>(P);
+          break;
+        default:
+          Bits = readRawElt<uint64_t>(P);
+          break;
+        }
+        return TableElt{Bits, IsInt ? TableElt::Int : TableElt::FP};
+      });
+  Res.Visited = std::max(Res.Visited, Shared);
+  return Res;
+}
+
+static LUTScanResult scanGenericLUT(Constant *Init, Type *LoadTy,
+                                    const APInt &Step, uint64_t ArraySize,
+                                    const DataLayout &DL) {
+  LUTScanResult Res;
+  Res.Results.resize(AllClassifiers.size());
+  SmallVector<uint32_t, 4> Pending;
+  for (uint32_t Idx = 0; Idx != AllClassifiers.size(); ++Idx)
+    Pending.push_back(Idx);
+
+  uint64_t StepVal = Step.getLimitedValue();
+  TableInfo T{LoadTy->isIntegerTy() ? LoadTy->getIntegerBitWidth() : 0,
+              (ArraySize + StepVal - 1) / StepVal};
+  DenseMap<Constant *, uint64_t> Opaque;
+  Res.Visited = runClassifiers(
+      T, Res.Results, Pending, [&](uint64_t I) -> std::optional<TableElt> {
+        APInt Offset(Step.getBitWidth(), I * StepVal);
+        Constant *Elt = ConstantFoldLoadFromConst(Init, LoadTy, Offset, DL);
+        // bail out if the array contains undef values
+        if (!Elt || isa<UndefValue>(Elt))
+          return std::nullopt;
+        if (auto *CI = dyn_cast<ConstantInt>(Elt);
+            CI && CI->getBitWidth() <= 64)
+          return TableElt{CI->getZExtValue(), TableElt::Int};
+        if (auto *CFP = dyn_cast<ConstantFP>(Elt)) {
+          APInt Bits = CFP->getValueAPF().bitcastToAPInt();
+          if (Bits.getBitWidth() <= 64)
+            return TableElt{Bits.getZExtValue(), TableElt::FP};
+        }
+        auto [It, Inserted] = Opaque.try_emplace(Elt, Opaque.size());
+        return TableElt{It->second, TableElt::Opaque};
+      });
+  return Res;
+}
+
+// Tables scanned by each path in --bench mode. Raw tables are also scanned by
+// the generic path to compare both throughput and results.
+struct ScanBench final {
+  uint64_t Tables = 0;
+  double Seconds = 0.0;
+};
+static ScanBench RawBench, GenericBench, FallbackBench;
+static uint32_t BenchMismatches = 0;
+
+template <typename Fn> static auto timeScan(ScanBench &B, Fn &&Scan) {
+  auto Start = std::chrono::steady_clock::now();
+  auto Res = Scan();
+  std::chrono::duration<double> Elapsed =
+      std::chrono::steady_clock::now() - Start;
+  B.Seconds += Elapsed.count();
+  return Res;
+}
+
+static LUTScanResult scanLUT(Constant *Init, Type *LoadTy, const APInt &Step,
+                             uint64_t ArraySize, const DataLayout &DL) {
+  if (!Bench) {
+    if (auto Res = scanRawLUT(Init, LoadTy, Step))
+      return std::move(*Res);
+    return scanGenericLUT(Init, LoadTy, Step, ArraySize, DL);
+  }
+  auto Raw = timeScan(RawBench, [&] { return scanRawLUT(Init, LoadTy, Step); });
+  if (!Raw) {
+    ++FallbackBench.Tables;
+    return timeScan(FallbackBench, [&] {
+      return scanGenericLUT(Init, LoadTy, Step, ArraySize, DL);
+    });
+  }
+  ++RawBench.Tables;
+  ++GenericBench.Tables;
+  auto Generic = timeScan(GenericBench, [&] {
+    return scanGenericLUT(Init, LoadTy, Step, ArraySize, DL);
+  });
+  if (!(*Raw == Generic))
+    ++BenchMismatches;
+  return std::move(*Raw);
+}
 
 static bool matchLoadLUT(LoadInst &LI) {
   if (LI.isVolatile())
@@ -85,51 +559,76 @@ static bool matchLoadLUT(LoadInst &LI) {
   if (Step.isNonPositive())
     return false;
   uint64_t ArraySize = DL.getTypeAllocSize(Init->getType()).getFixedValue();
+  if (ArraySize == 0)
+    return false;
 
   Value *Index = VariableOffsets.front().first;
   if (Index->getType()->getScalarSizeInBits() != IndexBW)
     return false;
-  auto &CostCounter = Cost[ArraySize];
 
   Type *LoadTy = LI.getType();
-  SmallMapVector<Constant *, uint64_t, 2> ValueMap;
-  // MultiMapIdx indicates that this value occurs more than once in the array.
-  constexpr uint64_t MultiMapIdx = static_cast<uint64_t>(-1);
-  uint32_t MultiMapElts = 0;
-  APInt Offset(IndexBW, 0);
-  for (uint64_t I = 0; Offset.getZExtValue() < ArraySize; ++I, Offset += Step) {
-    ++CostCounter;
-    Constant *Elt = ConstantFoldLoadFromConst(Init, LoadTy, Offset, DL);
-
-    if (!Elt)
-      return false;
-
-    // bail out if the array contains undef values
-    if (isa<UndefValue>(Elt))
-      return false;
-
-    if (auto It = ValueMap.find(Elt); It != ValueMap.end()) {
-      if (It->second == MultiMapIdx)
-        continue;
-      if (++MultiMapElts == 2)
-        return false;
-      It->second = MultiMapIdx;
-    } else {
-      if (ValueMap.size() == 2)
-        return false;
-      ValueMap.insert(std::make_pair(Elt, I));
-    }
+  auto [It, Inserted] =
+      ScanCache.try_emplace({GV, LoadTy, Step.getLimitedValue()});
+  if (Inserted) {
+    It->second = scanLUT(Init, LoadTy, Step, ArraySize, DL);
+    ScanDone += It->second.Visited;
+  } else
+    ScanAvoided += It->second.Visited;
+
+  MaxArraySize = std::max(MaxArraySize, ArraySize);
+  uint32_t Bucket = Log2_64_Ceil(ArraySize);
+  // Only the two-values fold decides whether the file is listed; the other
+  // classifiers are reported through the histograms.
+  bool Folded = false;
+  for (uint32_t Idx = 0; Idx != AllClassifiers.size(); ++Idx) {
+    auto &R = It->second.Results[Idx];
+    auto &B = Histograms[Idx][Bucket];
+    ++B.Loads;
+    B.Cost += R.Scanned;
+    B.Folds += R.Accepted;
+    if (AllClassifiers[Idx]->getName() == "two-values")
+      Folded = R.Accepted;
   }
 
-  if (ValueMap.size() != 1 && ValueMap.size() != 2)
-    std::abort();
-
-  Distrib[ArraySize]++;
-
   //   LI.print(errs() << "\nLoad: ");
   //   GEP->print(errs() << "\nGEP: ");
   //   Init->print(errs() << "\nInit: ");
   //   errs() << '\n';
+  return Folded;
+}
+
+// One row per classifier and size bucket up to the largest table, with
+// running totals so that each row is the outcome of using the bucket's upper
+// bound as the size threshold.
+static bool writeReport() {
+  std::error_code EC;
+  ToolOutputFile Out(ReportFile, EC, sys::fs::OF_None);
+  if (EC) {
+    errs() << ReportFile << ": " << EC.message() << '\n';
+    return false;
+  }
+  auto &OS = Out.os();
+  OS << "classifier,bucket,max_bytes,loads,folds,cost,cum_loads,cum_folds,"
+        "cum_cost\n";
+  uint32_t MaxBucket = Log2_64_Ceil(std::max<uint64_t>(MaxArraySize, 1));
+  for (uint32_t Idx = 0; Idx != AllClassifiers.size(); ++Idx) {
+    BucketStats Cum;
+    for (uint32_t Bucket = 0; Bucket <= MaxBucket; ++Bucket) {
+      auto It = Histograms[Idx].find(Bucket);
+      BucketStats B = It == Histograms[Idx].end() ? BucketStats{} : It->second;
+      Cum.Loads += B.Loads;
+      Cum.Folds += B.Folds;
+      Cum.Cost += B.Cost;
+      OS << AllClassifiers[Idx]->getName() << ',' << Bucket << ','
+         << (1ULL << Bucket) << ',' << B.Loads << ',' << B.Folds << ','
+         << B.Cost << ',' << Cum.Loads << ',' << Cum.Folds << ',' << Cum.Cost
+         << '\n';
+    }
+    errs() << AllClassifiers[Idx]->getName() << ": " << Cum.Folds << " of "
+           << Cum.Loads << " loads folded, " << Cum.Cost
+           << " elements scanned\n";
+  }
+  Out.keep();
   return true;
 }
 
@@ -138,6 +637,8 @@ int main(int argc, char **argv) {
   cl::ParseCommandLineOptions(argc, argv, "scanner\n");
 
   std::vector<std::string> BlockList{};
+  registerClassifiers();
+  Histograms.resize(AllClassifiers.size());
 
   std::vector<fs::path> InputFiles;
   for (auto &Entry : fs::recursive_directory_iterator(std::string(InputDir))) {
@@ -172,6 +673,7 @@ int main(int argc, char **argv) {
     // auto &DL = M->getDataLayout();
     // errs() << DL.getStringRepresentation() << '\n';
 
+    ScanCache.clear();
     bool Contains = false;
     for (auto &F : *M) {
       if (F.empty())
@@ -198,20 +700,24 @@ int main(int argc, char **argv) {
 
   errs() << Names.size() << '\n';
 
-  //   for (auto &[Size, Count] : Distrib)
-  //     errs() << Size << ": " << Count << '\n';
   //   for (auto &Name : Names)
   //     errs() << Name << '\n';
 
-  uint32_t CostAcc = 0;
-  uint32_t FoldAcc = 0;
-
-  errs() << "Thres(Byte) ScanCount FoldCount\n";
-  for (uint32_t Thres = 0; Thres < 100; ++Thres) {
-    CostAcc += Cost[Thres];
-    FoldAcc += Distrib[Thres];
-    if (Distrib[Thres])
-      errs() << Thres << ": " << CostAcc << ' ' << FoldAcc << '\n';
+  errs() << "Shared scan: " << ScanDone << " elements visited, " << ScanAvoided
+         << " visits answered from the cache\n";
+  if (!writeReport())
+    return EXIT_FAILURE;
+
+  if (Bench) {
+    auto Report = [](StringRef Name, const ScanBench &B) {
+      errs() << Name << ": " << B.Tables << " tables, "
+             << format("%.0f", B.Tables / std::max(B.Seconds, 1e-9))
+             << " tables/s\n";
+    };
+    Report("Raw fast path", RawBench);
+    Report("Generic path on the same tables", GenericBench);
+    Report("Generic fallback", FallbackBench);
+    errs() << "Mismatches: " << BenchMismatches << '\n';
   }
 
   return EXIT_SUCCESS;
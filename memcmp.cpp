@@ -34,6 +34,7 @@
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/ToolOutputFile.h>
 #include <llvm/Support/raw_ostream.h>
+#include "string-cache.h"
 #include <cstdint>
 #include <cstdlib>
 #include <filesystem>
@@ -68,6 +69,8 @@ int main(int argc, char **argv) {
   std::unordered_set<std::string> Dist1, Dist2;
   uint32_t Pattern1Count = 0;
   uint32_t Pattern2Count = 0;
+  // Constant string operands by length bucket.
+  std::map<uint32_t, uint32_t> OperandDist;
   uint32_t Count = 0;
 
   for (auto &Path : InputFiles) {
@@ -76,6 +79,8 @@ int main(int argc, char **argv) {
     if (!M)
       continue;
 
+    ConstantStringCache Strings{*M};
+    auto RelPath = fs::relative(Path, std::string(InputDir)).string();
     for (auto &F : *M) {
       if (F.empty())
         continue;
@@ -88,17 +93,19 @@ int main(int argc, char **argv) {
               continue;
             auto FuncName = Callee->getName();
             if (FuncName == "memcmp") {
+              for (uint32_t K = 0; K != 2; ++K)
+                if (auto Ref = Strings.lookup(Call->getArgOperand(K)))
+                  ++OperandDist[getLengthBucket(
+                      Ref->getLength(/*TrimAtNul=*/false))];
               for (auto *U : I.users()) {
                 if (match(U, m_SpecificICmp(ICmpInst::ICMP_SGT, m_Specific(&I),
                                             m_AllOnes()))) {
                   ++Pattern1Count;
-                  Dist1.insert(
-                      fs::relative(Path, std::string(InputDir)).string());
+                  Dist1.insert(RelPath);
                 } else if (match(U, m_SpecificICmp(ICmpInst::ICMP_SLT,
                                                    m_Specific(&I), m_One()))) {
                   ++Pattern2Count;
-                  Dist2.insert(
-                      fs::relative(Path, std::string(InputDir)).string());
+                  Dist2.insert(RelPath);
                 }
               }
             }
@@ -118,5 +125,9 @@ int main(int argc, char **argv) {
   errs() << "Pattern2 Count: " << Pattern2Count << '\n';
   for (auto &Path : Dist2)
     errs() << Path << '\n';
+  errs() << '\n';
+  errs() << "Constant operands by length bucket:\n";
+  for (auto [K, V] : OperandDist)
+    errs() << K << ' ' << V << '\n';
   return EXIT_SUCCESS;
 }
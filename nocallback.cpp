@@ -42,6 +42,8 @@
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/ToolOutputFile.h>
 #include <llvm/Support/raw_ostream.h>
+#include "call-graph.h"
+#include "function-analyses.h"
 #include <cstdint>
 #include <cstdlib>
 #include <filesystem>
@@ -95,41 +97,21 @@ int main(int argc, char **argv) {
       continue;
     // auto &DL = M->getDataLayout();
     // errs() << DL.getStringRepresentation() << '\n';
-    TargetLibraryInfoImpl TLIImpl(Triple(M->getTargetTriple()));
+    auto &TLIImpl = getTLIImpl(*M);
+    ModuleCallGraph CG{*M, TLIImpl};
 
-    bool Contains = false;
-    for (auto &F : *M) {
-      if (F.empty())
+    for (auto *F : CG.functions()) {
+      if (F->getReturnType()->isVoidTy())
         continue;
-      if (F.getReturnType()->isVoidTy())
+      if (F->hasWeakAnyLinkage())
         continue;
-      if (F.hasWeakAnyLinkage())
+      if (F->doesNotRecurse() || CG.isRecursive(*F))
         continue;
-      if (F.doesNotRecurse())
-        continue;
-      TargetLibraryInfo TLI(TLIImpl, &F);
-
-      bool LibFuncOnly = true;
-      std::set<LibFunc> LibFuncSet;
-      for (auto &BB : F) {
-        for (auto &I : BB) {
-          auto *Call = dyn_cast<CallBase>(&I);
-          if (!Call)
-            continue;
-          LibFunc LibFuncKind;
-          if (TLI.getLibFunc(*Call, LibFuncKind)) {
-            LibFuncSet.insert(LibFuncKind);
-          } else {
-            LibFuncOnly = false;
-            break;
-          }
-        }
-        if (!LibFuncOnly)
-          break;
-      }
 
-      if (LibFuncOnly >= 1) {
-        for (auto Func : LibFuncSet) {
+      auto &Facts = CG.getFacts(*F);
+      if (Facts.LibFuncOnly) {
+        TargetLibraryInfo TLI(TLIImpl, F);
+        for (auto Func : Facts.LibFuncs) {
           if (Names.insert(Func).second) {
             auto FuncName = TLI.getName(Func);
             errs() << ' ' << FuncName << '\n';
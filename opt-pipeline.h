@@ -0,0 +1,67 @@
+// SPDX-License-Identifier: MIT License
+// Copyright (c) 2025 Yingwei Zheng
+// This file is licensed under the MIT License.
+// See the LICENSE file for more information.
+
+// A pass pipeline that is built once and run on many modules (or functions).
+// Cached analysis results are dropped after each run so the managers can be
+// reused.
+
+#pragma once
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Analysis/CGSCCPassManager.h>
+#include <llvm/Analysis/LoopAnalysisManager.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Module.h>
+#include <llvm/IR/PassManager.h>
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Support/Error.h>
+
+namespace llvm {
+
+class OptPipeline final {
+  PassBuilder PB;
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+  ModulePassManager MPM;
+  FunctionPassManager FPM;
+
+public:
+  OptPipeline() {
+    PB.registerModuleAnalyses(MAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerFunctionAnalyses(FAM);
+    PB.registerLoopAnalyses(LAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+  }
+  OptPipeline(const OptPipeline &) = delete;
+  OptPipeline &operator=(const OptPipeline &) = delete;
+
+  // Accepts the same syntax as `opt -passes=`.
+  Error parse(StringRef Passes) { return PB.parsePassPipeline(MPM, Passes); }
+
+  // Function pipelines are run one function at a time with run(Function &).
+  Error parseFunction(StringRef Passes) {
+    return PB.parsePassPipeline(FPM, Passes);
+  }
+
+  void run(Module &M) {
+    MPM.run(M, MAM);
+    LAM.clear();
+    FAM.clear();
+    CGAM.clear();
+    MAM.clear();
+  }
+
+  // Returns true if the function pipeline changed F.
+  bool run(Function &F) {
+    bool Changed = !FPM.run(F, FAM).areAllPreserved();
+    FAM.clear();
+    return Changed;
+  }
+};
+
+} // namespace llvm
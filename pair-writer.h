@@ -0,0 +1,151 @@
+// SPDX-License-Identifier: MIT License
+// Copyright (c) 2025 Yingwei Zheng
+// This file is licensed under the MIT License.
+// See the LICENSE file for more information.
+
+// Emission of src/tgt module pairs for alive-tv. A pair can be split into
+// chunks of similar estimated verification cost so that one slow query only
+// loses its own chunk and the chunks can be verified in parallel.
+
+#pragma once
+
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/InstIterator.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/ToolOutputFile.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+
+namespace llvm {
+
+// Multiplications and divisions dominate the SMT solving time.
+constexpr uint64_t MulDivCost = 10;
+
+inline uint64_t estimateVerifyCost(const Function &F) {
+  uint64_t Cost = 0;
+  for (auto &I : instructions(F)) {
+    ++Cost;
+    switch (I.getOpcode()) {
+    case Instruction::Mul:
+    case Instruction::SDiv:
+    case Instruction::UDiv:
+    case Instruction::SRem:
+    case Instruction::URem:
+      Cost += MulDivCost;
+      break;
+    default:
+      if (auto *II = dyn_cast<IntrinsicInst>(&I))
+        if (II->getIntrinsicID() == Intrinsic::smul_with_overflow ||
+            II->getIntrinsicID() == Intrinsic::umul_with_overflow)
+          Cost += MulDivCost;
+      break;
+    }
+  }
+  return Cost;
+}
+
+inline bool writeModule(const Module &M, const std::string &Path) {
+  std::error_code EC;
+  ToolOutputFile Out(Path, EC, sys::fs::OF_None);
+  if (EC) {
+    errs() << Path << ": " << EC.message() << '\n';
+    return false;
+  }
+  M.print(Out.os(), nullptr);
+  Out.keep();
+  return true;
+}
+
+// Copy of M that only keeps the definitions of Funcs. Other functions are
+// dropped unless they are still referenced, in which case they become
+// declarations.
+inline std::unique_ptr<Module> extractFunctions(const Module &M,
+                                                const StringSet<> &Funcs) {
+  ValueToValueMapTy VMap;
+  auto Out = CloneModule(M, VMap, [&](const GlobalValue *GV) {
+    auto *F = dyn_cast<Function>(GV);
+    return !F || Funcs.contains(F->getName());
+  });
+  for (auto &F : make_early_inc_range(*Out))
+    if (F.isDeclaration() && F.use_empty())
+      F.eraseFromParent();
+  return Out;
+}
+
+// Writes Name.<k>.src/.tgt for each chunk and a sidecar Name.index with one
+// line per chunk: "<k> <cost> <func>,<func>,...". Functions are assigned to
+// the least loaded chunk in decreasing order of cost, with enough chunks that
+// each one stays around ChunkCost.
+inline bool writeChunkedPairs(const Module &Src, const Module &Tgt,
+                              const std::string &Name, uint64_t ChunkCost) {
+  SmallVector<std::pair<uint64_t, const Function *>, 0> Funcs;
+  uint64_t Total = 0;
+  for (auto &F : Src) {
+    if (F.isDeclaration())
+      continue;
+    uint64_t Cost = estimateVerifyCost(F);
+    if (auto *TgtF = Tgt.getFunction(F.getName()))
+      Cost += estimateVerifyCost(*TgtF);
+    Funcs.emplace_back(Cost, &F);
+    Total += Cost;
+  }
+  if (Funcs.empty())
+    return true;
+  stable_sort(Funcs, [](auto &A, auto &B) { return A.first > B.first; });
+
+  uint64_t NumChunks = std::clamp<uint64_t>(
+      (Total + ChunkCost - 1) / std::max<uint64_t>(ChunkCost, 1), 1,
+      Funcs.size());
+  SmallVector<uint64_t, 0> Load(NumChunks);
+  SmallVector<StringSet<>, 0> Chunks(NumChunks);
+  for (auto [Cost, F] : Funcs) {
+    auto K = std::min_element(Load.begin(), Load.end()) - Load.begin();
+    Load[K] += Cost;
+    Chunks[K].insert(F->getName());
+  }
+
+  std::error_code EC;
+  ToolOutputFile Index(Name + ".index", EC, sys::fs::OF_None);
+  if (EC) {
+    errs() << Name << ".index: " << EC.message() << '\n';
+    return false;
+  }
+  for (uint64_t K = 0; K != NumChunks; ++K) {
+    std::string ChunkName = Name + "." + std::to_string(K);
+    if (!writeModule(*extractFunctions(Src, Chunks[K]), ChunkName + ".src") ||
+        !writeModule(*extractFunctions(Tgt, Chunks[K]), ChunkName + ".tgt"))
+      return false;
+    Index.os() << K << ' ' << Load[K] << ' ';
+    bool First = true;
+    for (auto &F : Src) {
+      if (!Chunks[K].contains(F.getName()))
+        continue;
+      if (!First)
+        Index.os() << ',';
+      Index.os() << F.getName();
+      First = false;
+    }
+    Index.os() << '\n';
+  }
+  Index.keep();
+  return true;
+}
+
+// Writes Name.src/.tgt, or chunks of them if ChunkCost is non-zero.
+inline bool writePairs(const Module &Src, const Module &Tgt,
+                       const std::string &Name, uint64_t ChunkCost) {
+  if (ChunkCost)
+    return writeChunkedPairs(Src, Tgt, Name, ChunkCost);
+  return writeModule(Src, Name + ".src") && writeModule(Tgt, Name + ".tgt");
+}
+
+} // namespace llvm
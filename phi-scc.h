@@ -0,0 +1,173 @@
+// SPDX-License-Identifier: MIT License
+// Copyright (c) 2025 Yingwei Zheng
+// This file is licensed under the MIT License.
+// See the LICENSE file for more information.
+
+// Strongly connected components of PHI graphs. PHIs get dense per-function
+// indices, edges are stored in a flat CSR adjacency, and Tarjan's algorithm
+// runs on an explicit stack so that huge generated functions neither
+// overflow the call stack nor allocate per node.
+
+#pragma once
+
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+
+// Dense numbering of the PHIs of a function, in program order. Lookups
+// binary-search a sorted copy of the PHI pointers instead of hashing them.
+class PHINumbering final {
+  std::vector<PHINode *> PHIs;
+  std::vector<std::pair<const PHINode *, uint32_t>> Sorted;
+
+public:
+  static constexpr uint32_t NotFound = UINT32_MAX;
+
+  // Only numbers the PHIs accepted by Pred.
+  template <typename PredFn> PHINumbering(Function &F, PredFn Pred) {
+    for (auto &BB : F)
+      for (auto &PN : BB.phis())
+        if (Pred(PN)) {
+          Sorted.emplace_back(&PN, PHIs.size());
+          PHIs.push_back(&PN);
+        }
+    std::sort(Sorted.begin(), Sorted.end());
+  }
+  explicit PHINumbering(Function &F)
+      : PHINumbering(F, [](const PHINode &) { return true; }) {}
+
+  uint32_t size() const { return PHIs.size(); }
+  PHINode *operator[](uint32_t Idx) const { return PHIs[Idx]; }
+  ArrayRef<PHINode *> phis() const { return PHIs; }
+
+  uint32_t lookup(const Value *V) const {
+    auto *PN = dyn_cast<PHINode>(V);
+    if (!PN)
+      return NotFound;
+    auto It = std::lower_bound(Sorted.begin(), Sorted.end(),
+                               std::make_pair(PN, 0U));
+    if (It == Sorted.end() || It->first != PN)
+      return NotFound;
+    return It->second;
+  }
+};
+
+// Adjacency lists in compressed sparse row form. Nodes are added in index
+// order: push the edges of a node, then call finishNode().
+class CSRGraph final {
+  std::vector<uint32_t> Offsets{0};
+  std::vector<uint32_t> Targets;
+
+public:
+  void addEdge(uint32_t V) { Targets.push_back(V); }
+  void finishNode() { Offsets.push_back(Targets.size()); }
+
+  uint32_t size() const { return Offsets.size() - 1; }
+  ArrayRef<uint32_t> successors(uint32_t U) const {
+    return ArrayRef<uint32_t>(Targets).slice(Offsets[U],
+                                             Offsets[U + 1] - Offsets[U]);
+  }
+};
+
+// Edges from each numbered PHI to its numbered incoming PHIs, without
+// self-loops.
+inline CSRGraph buildPHIGraph(const PHINumbering &Numbering) {
+  CSRGraph G;
+  for (uint32_t U = 0; U != Numbering.size(); ++U) {
+    for (auto &V : Numbering[U]->incoming_values()) {
+      uint32_t Idx = Numbering.lookup(V);
+      if (Idx != PHINumbering::NotFound && Idx != U)
+        G.addEdge(Idx);
+    }
+    G.finishNode();
+  }
+  return G;
+}
+
+struct SCCResult final {
+  uint32_t NumComponents = 0;
+  // Component of each node. Components are numbered in reverse topological
+  // order, as Tarjan's algorithm completes them.
+  std::vector<uint32_t> Component;
+  // Nodes of component C are Members[Begin[C] .. Begin[C + 1]).
+  std::vector<uint32_t> Begin;
+  std::vector<uint32_t> Members;
+
+  ArrayRef<uint32_t> members(uint32_t C) const {
+    return ArrayRef<uint32_t>(Members).slice(Begin[C], Begin[C + 1] - Begin[C]);
+  }
+};
+
+inline SCCResult computeSCCs(const CSRGraph &G) {
+  uint32_t N = G.size();
+  SCCResult Res;
+  Res.Component.resize(N);
+  // DFS preorder index (0 = unvisited) and lowlink of each node.
+  std::vector<uint32_t> Index(N), Low(N);
+  std::vector<bool> OnStack(N);
+  std::vector<uint32_t> Stack;
+  // Explicit DFS call stack: a node and the position of its next edge.
+  std::vector<std::pair<uint32_t, uint32_t>> Frames;
+  uint32_t Counter = 0;
+
+  auto Enter = [&](uint32_t U) {
+    Index[U] = Low[U] = ++Counter;
+    Stack.push_back(U);
+    OnStack[U] = true;
+    Frames.emplace_back(U, 0);
+  };
+
+  for (uint32_t Root = 0; Root != N; ++Root) {
+    if (Index[Root])
+      continue;
+    Enter(Root);
+    while (!Frames.empty()) {
+      auto [U, Edge] = Frames.back();
+      auto Succs = G.successors(U);
+      if (Edge != Succs.size()) {
+        ++Frames.back().second;
+        uint32_t V = Succs[Edge];
+        if (!Index[V])
+          Enter(V);
+        else if (OnStack[V])
+          Low[U] = std::min(Low[U], Index[V]);
+        continue;
+      }
+
+      Frames.pop_back();
+      if (!Frames.empty()) {
+        uint32_t Parent = Frames.back().first;
+        Low[Parent] = std::min(Low[Parent], Low[U]);
+      }
+      if (Low[U] != Index[U])
+        continue;
+      uint32_t C = Res.NumComponents++, V;
+      do {
+        V = Stack.back();
+        Stack.pop_back();
+        OnStack[V] = false;
+        Res.Component[V] = C;
+      } while (V != U);
+    }
+  }
+
+  // Group the nodes by component with a counting sort.
+  Res.Begin.assign(Res.NumComponents + 1, 0);
+  for (uint32_t C : Res.Component)
+    ++Res.Begin[C + 1];
+  for (uint32_t C = 0; C != Res.NumComponents; ++C)
+    Res.Begin[C + 1] += Res.Begin[C];
+  Res.Members.resize(N);
+  std::vector<uint32_t> Next(Res.Begin.begin(), Res.Begin.end() - 1);
+  for (uint32_t U = 0; U != N; ++U)
+    Res.Members[Next[Res.Component[U]]++] = U;
+  return Res;
+}
+
+} // namespace llvm
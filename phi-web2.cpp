@@ -42,6 +42,8 @@
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/ToolOutputFile.h>
 #include <llvm/Support/raw_ostream.h>
+#include "phi-scc.h"
+#include <algorithm>
 #include <cstdint>
 #include <cstdlib>
 #include <filesystem>
@@ -58,6 +60,13 @@ static cl::opt<std::string>
     InputDir(cl::Positional, cl::desc("<directory for input LLVM IR files>"),
              cl::Required, cl::value_desc("inputdir"));
 
+static cl::opt<bool> Verify(
+    "verify",
+    cl::desc("Check the web sizes against a separate walk from every PHI"),
+    cl::init(false));
+
+// Returns the number of PHIs reachable from Root through incoming values if
+// they all have the same non-PHI incoming value, or 0 otherwise.
 static uint32_t visitPHI(PHINode *Root) {
   Value *CommonV = nullptr;
   SmallVector<PHINode *> WorkList({Root});
@@ -79,6 +88,92 @@ static uint32_t visitPHI(PHINode *Root) {
   return Visited.size();
 }
 
+// Values flowing into a web from outside: none, one, or several.
+struct WebValue final {
+  Value *V = nullptr;
+  bool Conflict = false;
+
+  void merge(Value *Other) {
+    if (Conflict)
+      return;
+    if (!V)
+      V = Other;
+    else if (V != Other)
+      Conflict = true;
+  }
+  void merge(const WebValue &Other) {
+    if (Other.Conflict)
+      Conflict = true;
+    else if (Other.V)
+      merge(Other.V);
+  }
+};
+
+// Same result as calling visitPHI on every PHI of F, but each PHI web is
+// walked once. All PHIs in an SCC reach the same set of PHIs, so the common
+// incoming value and the reachable size are computed per SCC, in reverse
+// topological order, and attributed to every member.
+static void visitWebs(Function &F, std::map<uint32_t, uint32_t> &Dist) {
+  PHINumbering PHIs{F};
+  CSRGraph G = buildPHIGraph(PHIs);
+  auto SCCs = computeSCCs(G);
+  uint32_t NumComponents = SCCs.NumComponents;
+  std::vector<WebValue> Values(NumComponents);
+  // Number of PHIs reachable from a component, including its own members.
+  // Only computed for components without conflicting incoming values.
+  std::vector<uint32_t> Reach(NumComponents);
+  std::vector<uint32_t> Seen(NumComponents, UINT32_MAX);
+  SmallVector<uint32_t, 8> Succs, WorkList;
+
+  for (uint32_t C = 0; C != NumComponents; ++C) {
+    auto Members = SCCs.members(C);
+    // A single PHI only reaches itself through a self-loop.
+    bool Cyclic = Members.size() > 1;
+    Succs.clear();
+    for (auto U : Members)
+      for (auto &V : PHIs[U]->incoming_values()) {
+        uint32_t Idx = PHIs.lookup(V);
+        if (Idx == PHINumbering::NotFound)
+          Values[C].merge(V.get());
+        else if (Idx == U)
+          Cyclic = true;
+        else if (uint32_t D = SCCs.Component[Idx]; D != C) {
+          // Successor components are numbered first, so they are complete.
+          Values[C].merge(Values[D]);
+          Succs.push_back(D);
+        }
+      }
+    if (Values[C].Conflict)
+      continue;
+
+    llvm::sort(Succs);
+    Succs.erase(std::unique(Succs.begin(), Succs.end()), Succs.end());
+    Reach[C] = Members.size();
+    if (Succs.size() == 1) {
+      Reach[C] += Reach[Succs.front()];
+    } else if (Succs.size() > 1) {
+      // The reachable sets of the successors may overlap, so walk the
+      // condensation once for this component.
+      WorkList.assign(Succs.begin(), Succs.end());
+      for (auto D : Succs)
+        Seen[D] = C;
+      while (!WorkList.empty()) {
+        uint32_t D = WorkList.pop_back_val();
+        Reach[C] += SCCs.members(D).size();
+        for (auto U : SCCs.members(D))
+          for (auto Idx : G.successors(U))
+            if (uint32_t E = SCCs.Component[Idx]; Seen[E] != C) {
+              Seen[E] = C;
+              WorkList.push_back(E);
+            }
+      }
+    }
+
+    if (uint32_t Size = Cyclic ? Reach[C] : Reach[C] - 1)
+      Dist[Size] += Members.size();
+  }
+}
+
 int main(int argc, char **argv) {
   InitLLVM Init{argc, argv};
   cl::ParseCommandLineOptions(argc, argv, "scanner\n");
@@ -107,6 +202,7 @@ int main(int argc, char **argv) {
   auto BaseDir = fs::absolute(std::string(InputDir));
   uint32_t Count = 0;
   std::map<uint32_t, uint32_t> Dist;
+  std::map<uint32_t, uint32_t> WalkDist;
 
   for (auto &Path : InputFiles) {
     SMDiagnostic Err;
@@ -122,15 +218,20 @@ int main(int argc, char **argv) {
       if (F.empty())
         continue;
 
-      for (auto &BB : F)
-        for (auto &PHI : BB.phis())
-          if (auto C = visitPHI(&PHI))
-            Dist[C]++;
+      visitWebs(F, Dist);
+      if (Verify)
+        for (auto &BB : F)
+          for (auto &PHI : BB.phis())
+            if (auto C = visitPHI(&PHI))
+              WalkDist[C]++;
     }
     errs() << "\rProgress: " << ++Count;
   }
   errs() << '\n';
 
+  if (Verify && WalkDist != Dist)
+    errs() << "Mismatch between the per-PHI walk and the web computation\n";
+
   for (auto [K, V] : Dist)
     outs() << K << ' ' << V << '\n';
 
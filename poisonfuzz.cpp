@@ -6,7 +6,12 @@
 #include <llvm/ADT/APInt.h>
 #include <llvm/ADT/ArrayRef.h>
 #include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/ScopeExit.h>
 #include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/ADT/Twine.h>
 #include <llvm/Analysis/InstSimplifyFolder.h>
 #include <llvm/Analysis/ValueTracking.h>
 #include <llvm/IR/Analysis.h>
@@ -27,7 +32,9 @@
 #include <llvm/IR/IntrinsicInst.h>
 #include <llvm/IR/Intrinsics.h>
 #include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Metadata.h>
 #include <llvm/IR/Module.h>
+#include <llvm/IR/ModuleSlotTracker.h>
 #include <llvm/IR/Operator.h>
 #include <llvm/IR/PassManager.h>
 #include <llvm/IR/PatternMatch.h>
@@ -48,15 +55,111 @@
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/ToolOutputFile.h>
 #include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
 #include <llvm/Transforms/InstCombine/InstCombine.h>
 #include <llvm/Transforms/Scalar/LoopPassManager.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include "opt-pipeline.h"
+#include "pair-writer.h"
 #include "pcg_random.hpp"
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <csignal>
 #include <cstdlib>
+#include <filesystem>
+#include <mutex>
 #include <random>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
 using namespace llvm;
-pcg64 Rng(pcg_extras::seed_seq_from<std::random_device>{});
+namespace fs = std::filesystem;
+
+static cl::opt<std::string>
+    InputFile(cl::Positional,
+              cl::desc("<input LLVM IR file or corpus directory>"),
+              cl::Required, cl::value_desc("input"));
+
+static cl::opt<std::string>
+    OutputName(cl::Positional,
+               cl::desc("<output prefix, or output directory for a corpus>"),
+               cl::Required, cl::value_desc("output"));
+
+static cl::opt<uint64_t>
+    Seed("seed", cl::desc("Base seed (default: a random seed)"), cl::init(0));
+
+static cl::opt<uint64_t> ChunkCost(
+    "chunk-cost",
+    cl::desc("Split the output into <output>.<k>.src/.tgt chunks of about "
+             "this estimated verification cost, listed in <output>.index "
+             "(0 = a single pair)"),
+    cl::init(0));
+
+static cl::opt<uint32_t>
+    Mutants("mutants",
+            cl::desc("Number of mutants generated from a single parse of the "
+                     "input, written to <output>-<k> (0 = one mutant written "
+                     "to <output>). Mutant k uses the seed mixSeed(seed, k), "
+                     "which is recorded in !poisonfuzz.seed"),
+            cl::init(0));
+
+static cl::opt<uint32_t>
+    Jobs("jobs",
+         cl::desc("Number of threads for --mutants and corpus directories "
+                  "(0 = all cores)"),
+         cl::init(0));
+
+static cl::opt<uint32_t> FileTimeout(
+    "file-timeout",
+    cl::desc("Time limit in seconds per corpus file, checked between "
+             "functions. A file still running after twice the limit is "
+             "killed (0 = no limit)"),
+    cl::init(20));
+
+static cl::list<std::string>
+    Replay("replay",
+           cl::desc("Only mutate and emit the named functions. Use together "
+                    "with the --seed recorded in !poisonfuzz.seed"),
+           cl::CommaSeparated, cl::value_desc("func"));
+
+static cl::opt<bool> PruneUnchanged(
+    "prune-unchanged",
+    cl::desc("Only emit functions whose InstCombine output differs from the "
+             "InstCombine output of the unmutated input"),
+    cl::init(true));
+
+static std::atomic_uint64_t PrunedMutants{0};
+static std::atomic_uint64_t PrunedFuncs{0};
+static std::atomic_uint64_t KeptFuncs{0};
+
+// Prune counts of one PairEmitter. Corpus mode journals them per file, since
+// the global counters above live in the forked pool.
+struct PruneStats final {
+  uint64_t Mutants = 0;
+  uint64_t Funcs = 0;
+  uint64_t Kept = 0;
+};
+
+// Reseeded for each function, see getSubSeed.
+thread_local pcg64 Rng;
+
+// splitmix64 finalizer.
+static uint64_t mixSeed(uint64_t Base, uint64_t Idx) {
+  uint64_t Z = Base + (Idx + 1) * 0x9e3779b97f4a7c15ULL;
+  Z = (Z ^ (Z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  Z = (Z ^ (Z >> 27)) * 0x94d049bb133111ebULL;
+  return Z ^ (Z >> 31);
+}
+
+// The per-function seed only depends on the base seed and the function name,
+// so a single function can be replayed regardless of its position.
+static uint64_t getSubSeed(uint64_t BaseSeed, const Function &F) {
+  return mixSeed(BaseSeed, xxh3_64bits(F.getName()));
+}
 
 static uint32_t randomUInt(uint32_t Min, uint32_t Max) {
   return std::uniform_int_distribution<uint32_t>(Min, Max)(Rng);
@@ -153,55 +256,538 @@ static bool mutate(Function &F) {
   return Changed;
 }
 
-int main(int argc, char **argv) {
-  InitLLVM Init{argc, argv};
+using Clock = std::chrono::steady_clock;
+// Deadline for the cooperative time limit of a corpus file.
+using Deadline = Clock::time_point;
 
-  std::error_code ec;
-  LLVMContext Ctx;
+static bool isExpired(Deadline D) {
+  return D != Deadline::max() && Clock::now() > D;
+}
+
+static std::unique_ptr<Module> parseInput(StringRef Path, LLVMContext &Ctx) {
   SMDiagnostic Err;
-  auto M = parseIRFile(argv[1], Err, Ctx);
-  if (!M)
-    return EXIT_FAILURE;
+  auto M = parseIRFile(Path, Err, Ctx);
+  if (!M) {
+    Err.print("poisonfuzz", errs());
+    return nullptr;
+  }
   M->setSourceFileName("");
   M->setModuleIdentifier("");
+  return M;
+}
+
+// Records the seeds in metadata and mutates every function (or only the
+// replayed ones). Returns true if anything changed. Stops early once D has
+// passed.
+static bool mutateModule(Module &M, uint64_t BaseSeed,
+                         const StringSet<> &ReplaySet,
+                         Deadline D = Deadline::max()) {
+  auto *I64Ty = Type::getInt64Ty(M.getContext());
+  auto GetSeedMD = [&](uint64_t V) {
+    return MDNode::get(M.getContext(),
+                       ConstantAsMetadata::get(ConstantInt::get(I64Ty, V)));
+  };
+  M.getOrInsertNamedMetadata("poisonfuzz.seed")
+      ->addOperand(GetSeedMD(BaseSeed));
 
   bool Changed = false;
-  for (auto &F : *M) {
+  for (auto &F : M) {
     if (F.empty())
       continue;
+    if (isExpired(D))
+      break;
+    if (!ReplaySet.empty() && !ReplaySet.contains(F.getName())) {
+      F.deleteBody();
+      continue;
+    }
+    uint64_t SubSeed = getSubSeed(BaseSeed, F);
+    Rng.seed(SubSeed);
+    F.setMetadata("poisonfuzz.seed", GetSeedMD(SubSeed));
     uint32_t E = randomUInt(1, 4);
     for (uint32_t I = 0; I != E; ++I)
       Changed |= mutate(F);
   }
+  return Changed;
+}
+
+// Hash of the printed instructions of F. Unlike StructuralHash it covers
+// poison flags and call attributes, which are exactly what mutate changes.
+// Metadata slot numbers are left out: they depend on module-level metadata,
+// and mutants carry !poisonfuzz.seed nodes that the baseline does not. MST
+// is shared by all functions of F's module.
+static uint64_t hashFunctionBody(const Function &F, ModuleSlotTracker &MST) {
+  std::string Str;
+  raw_string_ostream OS(Str);
+  MST.incorporateFunction(F);
+  for (auto &Arg : F.args())
+    OS << *Arg.getType() << ' ' << Arg.getName() << '\n';
+  for (auto &BB : F) {
+    BB.printAsOperand(OS, /*PrintType=*/false, MST);
+    OS << '\n';
+    for (auto &I : BB) {
+      I.print(OS, MST);
+      OS << '\n';
+    }
+  }
+  // Drop the digits of every "!N" reference.
+  std::string Hashed;
+  Hashed.reserve(Str.size());
+  for (size_t I = 0; I != Str.size(); ++I) {
+    Hashed += Str[I];
+    if (Str[I] == '!')
+      while (I + 1 != Str.size() && isDigit(Str[I + 1]))
+        ++I;
+  }
+  return xxh3_64bits(Hashed);
+}
+
+static void dropFunction(Function &F) {
+  if (F.use_empty())
+    F.eraseFromParent();
+  else
+    F.deleteBody();
+}
+
+enum class EmitStatus { Ok, Timeout, Error };
+
+// Runs InstCombine on mutants and writes the src/tgt pairs. With
+// --prune-unchanged, functions whose optimized form is the same as the
+// optimized form of the unmutated input are left out.
+class PairEmitter final {
+  OptPipeline InstCombine;
+  StringMap<uint64_t> Baseline;
+  PruneStats Stats;
+
+  // InstCombine is run one function at a time so that the deadline can be
+  // checked in between.
+  bool runInstCombine(Module &M, Deadline D) {
+    for (auto &F : M) {
+      if (F.empty())
+        continue;
+      if (isExpired(D))
+        return false;
+      InstCombine.run(F);
+    }
+    return true;
+  }
+
+  // Returns the number of functions left in M.
+  uint32_t prune(Module &SrcM, Module &M) {
+    uint32_t Kept = 0;
+    ModuleSlotTracker MST(&M, /*ShouldInitializeAllMetadata=*/false);
+    for (auto &F : make_early_inc_range(M)) {
+      if (F.empty())
+        continue;
+      auto It = Baseline.find(F.getName());
+      if (!PruneUnchanged || It == Baseline.end() ||
+          It->second != hashFunctionBody(F, MST)) {
+        ++Kept;
+        continue;
+      }
+      ++PrunedFuncs;
+      ++Stats.Funcs;
+      dropFunction(*SrcM.getFunction(F.getName()));
+      dropFunction(F);
+    }
+    KeptFuncs += Kept;
+    Stats.Kept += Kept;
+    return Kept;
+  }
+
+public:
+  explicit PairEmitter(const Module &M, Deadline D = Deadline::max()) {
+    cantFail(InstCombine.parseFunction("instcombine"));
+    if (!PruneUnchanged)
+      return;
+    auto Optimized = CloneModule(M);
+    if (!runInstCombine(*Optimized, D))
+      return;
+    ModuleSlotTracker MST(Optimized.get(),
+                          /*ShouldInitializeAllMetadata=*/false);
+    for (auto &F : *Optimized)
+      if (!F.empty())
+        Baseline[F.getName()] = hashFunctionBody(F, MST);
+  }
+
+  EmitStatus emit(Module &M, const std::string &Out,
+                  Deadline D = Deadline::max()) {
+    auto SrcM = CloneModule(M);
+    // The unpruned src is written up front so that a crash in InstCombine
+    // leaves a reproducer behind.
+    if (!ChunkCost && !writeModule(*SrcM, Out + ".src"))
+      return EmitStatus::Error;
+    bool Finished = runInstCombine(M, D);
+    if (!Finished || !prune(*SrcM, M)) {
+      if (!ChunkCost)
+        sys::fs::remove(Out + ".src");
+      if (!Finished)
+        return EmitStatus::Timeout;
+      ++PrunedMutants;
+      ++Stats.Mutants;
+      return EmitStatus::Ok;
+    }
+    return writePairs(*SrcM, M, Out, ChunkCost) ? EmitStatus::Ok
+                                                : EmitStatus::Error;
+  }
 
-  if (!Changed)
-    return EXIT_SUCCESS;
-
-  std::string Out = argv[2];
-  auto OutSrc = std::make_unique<llvm::ToolOutputFile>(Out + ".src", ec,
-                                                       llvm::sys::fs::OF_None);
-  auto OutTgt = std::make_unique<llvm::ToolOutputFile>(Out + ".tgt", ec,
-                                                       llvm::sys::fs::OF_None);
-  M->print(OutSrc->os(), nullptr);
-  OutSrc->keep();
-  OutSrc.reset();
-  PassBuilder PB;
-
-  LoopAnalysisManager LAM;
-  FunctionAnalysisManager FAM;
-  CGSCCAnalysisManager CGAM;
-  ModulePassManager MPM;
-  ModuleAnalysisManager MAM;
-
-  PB.registerModuleAnalyses(MAM);
-  PB.registerCGSCCAnalyses(CGAM);
-  PB.registerFunctionAnalyses(FAM);
-  PB.registerLoopAnalyses(LAM);
-  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
-
-  MPM.addPass(createModuleToFunctionPassAdaptor(InstCombinePass{}));
-  MPM.run(*M, MAM);
-  M->print(OutTgt->os(), nullptr);
-  OutTgt->keep();
+  const PruneStats &getPruneStats() const { return Stats; }
+};
+
+static void printPruneSummary() {
+  if (PruneUnchanged)
+    errs() << "Pruned: " << PrunedMutants << " mutants, " << PrunedFuncs
+           << " functions unchanged after InstCombine, " << KeptFuncs
+           << " functions kept\n";
+}
+
+// Corpus-directory mode. A supervisor process forks a child that runs a
+// persistent thread pool over the corpus. Every file is logged to
+// <output>/journal.tsv when it starts and when it finishes, so if the child
+// crashes or hangs, the supervisor knows which files were in flight. Those
+// files are then rerun one per forked process to isolate the culprit, and
+// the pool is restarted on the rest. Rerunning with the same output directory
+// resumes from the journal.
+//
+// Output tree:
+//   <output>/pairs/<file>/<k>.src/.tgt  mutant k of <file>
+//   <output>/crashes/<file>.ll          inputs that crash or hang
+//   <output>/journal.tsv                start/finish records
+class Journal final {
+  std::mutex Lock;
+  std::unique_ptr<raw_fd_ostream> OS;
+
+public:
+  bool open(const std::string &Path) {
+    std::error_code EC;
+    OS = std::make_unique<raw_fd_ostream>(Path, EC, sys::fs::OF_Append);
+    if (EC) {
+      errs() << Path << ": " << EC.message() << '\n';
+      return false;
+    }
+    return true;
+  }
+  // Each record is written with a single flush so that a crash cannot leave a
+  // partial line behind. Finish records of files that got as far as pruning
+  // carry the pruned mutants, pruned functions and kept functions as three
+  // extra fields.
+  void record(StringRef Status, StringRef File, uint64_t Value,
+              const PruneStats *Pruned = nullptr) {
+    std::string Line = (Status + "\t" + File + "\t" + Twine(Value)).str();
+    if (Pruned)
+      Line += ("\t" + Twine(Pruned->Mutants) + "\t" + Twine(Pruned->Funcs) +
+               "\t" + Twine(Pruned->Kept))
+                  .str();
+    Line += '\n';
+    std::lock_guard Guard(Lock);
+    *OS << Line;
+    OS->flush();
+  }
+};
+
+struct JournalState final {
+  StringMap<std::string> Done;
+  // Files that have been started but not finished, with the start time in
+  // milliseconds since the epoch.
+  StringMap<uint64_t> InFlight;
+  // Prune counts of the finished files that recorded them.
+  StringMap<PruneStats> Pruned;
+};
+
+static uint64_t getWallMillis() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+static JournalState readJournal(const std::string &Path) {
+  JournalState State;
+  auto Buf = MemoryBuffer::getFile(Path);
+  if (!Buf)
+    return State;
+  SmallVector<StringRef, 0> Lines;
+  (*Buf)->getBuffer().split(Lines, '\n', -1, /*KeepEmpty=*/false);
+  for (auto Line : Lines) {
+    SmallVector<StringRef, 6> Fields;
+    Line.split(Fields, '\t');
+    if (Fields.size() != 3 && Fields.size() != 6)
+      continue;
+    if (Fields[0] == "start") {
+      uint64_t Start = 0;
+      Fields[2].getAsInteger(10, Start);
+      State.InFlight[Fields[1]] = Start;
+      continue;
+    }
+    State.InFlight.erase(Fields[1]);
+    State.Done[Fields[1]] = Fields[0].str();
+    if (Fields.size() == 6) {
+      auto &P = State.Pruned[Fields[1]];
+      Fields[3].getAsInteger(10, P.Mutants);
+      Fields[4].getAsInteger(10, P.Funcs);
+      Fields[5].getAsInteger(10, P.Kept);
+    }
+  }
+  return State;
+}
+
+struct CorpusTask final {
+  std::string Path;
+  // Path relative to the corpus directory.
+  std::string Rel;
+};
+
+// Mutates one corpus file Mutants times (at least once). The file seed only
+// depends on the base seed and the relative path. Returns the status name
+// recorded in the journal.
+static StringRef processFile(const CorpusTask &Task, const fs::path &OutDir,
+                             uint64_t BaseSeed, const StringSet<> &ReplaySet,
+                             uint32_t &Emitted, PruneStats &Pruned) {
+  Deadline D = FileTimeout
+                   ? Clock::now() + std::chrono::seconds(FileTimeout)
+                   : Deadline::max();
+  LLVMContext Ctx;
+  auto M = parseInput(Task.Path, Ctx);
+  if (!M)
+    return "error";
+  fs::path Dir = OutDir / "pairs" / fs::path{Task.Rel}.replace_extension();
+  std::error_code EC;
+  fs::create_directories(Dir, EC);
+  if (EC)
+    return "error";
+
+  uint64_t FileSeed = mixSeed(BaseSeed, xxh3_64bits(Task.Rel));
+  PairEmitter Emitter{*M, D};
+  auto SaveStats =
+      make_scope_exit([&] { Pruned = Emitter.getPruneStats(); });
+  for (uint32_t K = 0; K < std::max(1U, uint32_t(Mutants)); ++K) {
+    auto Mutant = CloneModule(*M);
+    bool Changed = mutateModule(*Mutant, mixSeed(FileSeed, K), ReplaySet, D);
+    if (isExpired(D))
+      return "timeout";
+    if (!Changed)
+      continue;
+    switch (Emitter.emit(*Mutant, (Dir / std::to_string(K)).string(), D)) {
+    case EmitStatus::Ok:
+      ++Emitted;
+      break;
+    case EmitStatus::Timeout:
+      return "timeout";
+    case EmitStatus::Error:
+      return "error";
+    }
+  }
+  return "ok";
+}
+
+// Body of the pool process.
+static int runPool(ArrayRef<CorpusTask> Tasks, const fs::path &OutDir,
+                   uint64_t BaseSeed, const StringSet<> &ReplaySet) {
+  Journal Log;
+  if (!Log.open((OutDir / "journal.tsv").string()))
+    return EXIT_FAILURE;
+  std::atomic_size_t Next{0};
+  uint32_t NumJobs =
+      Jobs ? Jobs : std::max(1U, std::thread::hardware_concurrency());
+  std::vector<std::jthread> Workers;
+  for (uint32_t I = 0; I < NumJobs; ++I)
+    Workers.emplace_back([&] {
+      for (size_t Idx = Next++; Idx < Tasks.size(); Idx = Next++) {
+        auto &Task = Tasks[Idx];
+        Log.record("start", Task.Rel, getWallMillis());
+        uint32_t Emitted = 0;
+        PruneStats Pruned;
+        auto Status =
+            processFile(Task, OutDir, BaseSeed, ReplaySet, Emitted, Pruned);
+        Log.record(Status, Task.Rel, Emitted, &Pruned);
+      }
+    });
+  Workers.clear();
   return EXIT_SUCCESS;
 }
+
+// Fork-per-file fallback for a file that was in flight when the pool died.
+// A hang is cut off with a hard alarm.
+static void runIsolated(const CorpusTask &Task, const fs::path &OutDir,
+                        uint64_t BaseSeed, const StringSet<> &ReplaySet) {
+  Journal Log;
+  if (!Log.open((OutDir / "journal.tsv").string()))
+    return;
+  pid_t Pid = fork();
+  if (Pid == 0) {
+    if (FileTimeout)
+      alarm(2 * FileTimeout);
+    uint32_t Emitted = 0;
+    PruneStats Pruned;
+    auto Status =
+        processFile(Task, OutDir, BaseSeed, ReplaySet, Emitted, Pruned);
+    Log.record(Status, Task.Rel, Emitted, &Pruned);
+    _exit(EXIT_SUCCESS);
+  }
+  if (Pid < 0) {
+    Log.record("error", Task.Rel, 0);
+    return;
+  }
+  int WStatus = 0;
+  if (waitpid(Pid, &WStatus, 0) < 0) {
+    Log.record("error", Task.Rel, 0);
+    return;
+  }
+  // Only a clean exit after the child journaled the file counts as done; an
+  // exit(1) from report_fatal_error is a crash like any signal.
+  if (WIFEXITED(WStatus) && WEXITSTATUS(WStatus) == EXIT_SUCCESS &&
+      readJournal((OutDir / "journal.tsv").string()).Done.contains(Task.Rel))
+    return;
+  bool Hang = WIFSIGNALED(WStatus) && WTERMSIG(WStatus) == SIGALRM;
+  Log.record(Hang ? "hang" : "crash", Task.Rel, 0);
+  fs::path Copy = OutDir / "crashes" / Task.Rel;
+  std::error_code EC;
+  fs::create_directories(Copy.parent_path(), EC);
+  fs::copy_file(Task.Path, Copy, fs::copy_options::overwrite_existing, EC);
+}
+
+static int runCorpus(uint64_t BaseSeed, const StringSet<> &ReplaySet) {
+  fs::path InDir{std::string{InputFile}};
+  fs::path OutDir{std::string{OutputName}};
+  std::error_code EC;
+  fs::create_directories(OutDir, EC);
+  if (EC) {
+    errs() << OutDir.string() << ": " << EC.message() << '\n';
+    return EXIT_FAILURE;
+  }
+  std::vector<CorpusTask> Tasks;
+  for (auto &Entry : fs::recursive_directory_iterator(InDir)) {
+    if (!Entry.is_regular_file() || Entry.path().extension() != ".ll")
+      continue;
+    Tasks.push_back(
+        {Entry.path().string(), fs::relative(Entry.path(), InDir).string()});
+  }
+  sort(Tasks, [](auto &A, auto &B) { return A.Rel < B.Rel; });
+  std::string JournalPath = (OutDir / "journal.tsv").string();
+
+  while (true) {
+    auto State = readJournal(JournalPath);
+    for (auto &Task : Tasks)
+      if (State.InFlight.contains(Task.Rel) && !State.Done.contains(Task.Rel))
+        runIsolated(Task, OutDir, BaseSeed, ReplaySet);
+
+    State = readJournal(JournalPath);
+    std::vector<CorpusTask> Pending;
+    for (auto &Task : Tasks)
+      if (!State.Done.contains(Task.Rel))
+        Pending.push_back(Task);
+    if (Pending.empty())
+      break;
+
+    pid_t Pid = fork();
+    if (Pid < 0) {
+      errs() << "error: fork failed\n";
+      return EXIT_FAILURE;
+    }
+    if (Pid == 0)
+      _exit(runPool(Pending, OutDir, BaseSeed, ReplaySet));
+
+    // Watchdog: a pass that never returns cannot be stopped cooperatively,
+    // so the pool is killed once a file has run for twice the time limit.
+    int WStatus = 0;
+    while (waitpid(Pid, &WStatus, WNOHANG) == 0) {
+      std::this_thread::sleep_for(std::chrono::seconds(1));
+      if (!FileTimeout)
+        continue;
+      uint64_t Now = getWallMillis();
+      for (auto &[File, Start] : readJournal(JournalPath).InFlight)
+        if (Now > Start + 2000ULL * FileTimeout) {
+          kill(Pid, SIGKILL);
+          break;
+        }
+    }
+    // Any unclean exit of the pool, a signal or an exit(1) from a pass,
+    // leaves its in-flight files to be isolated on the next iteration. With
+    // none in flight there is nothing to retry.
+    bool Clean = WIFEXITED(WStatus) && WEXITSTATUS(WStatus) == EXIT_SUCCESS;
+    if (!Clean && readJournal(JournalPath).InFlight.empty()) {
+      errs() << "error: worker pool failed\n";
+      return EXIT_FAILURE;
+    }
+  }
+
+  auto State = readJournal(JournalPath);
+  StringMap<uint32_t> Summary;
+  for (auto &[File, Status] : State.Done)
+    ++Summary[Status];
+  errs() << "Files: " << Tasks.size() << " (seed " << BaseSeed << ")\n";
+  for (auto &[Status, Count] : Summary)
+    errs() << "  " << Status << ": " << Count << '\n';
+  // The pool's counters died with it; add up the journaled ones instead.
+  for (auto &[File, P] : State.Pruned) {
+    PrunedMutants += P.Mutants;
+    PrunedFuncs += P.Funcs;
+    KeptFuncs += P.Kept;
+  }
+  printPruneSummary();
+  return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv) {
+  InitLLVM Init{argc, argv};
+  cl::ParseCommandLineOptions(argc, argv, "poison flag fuzzer\n");
+
+  uint64_t BaseSeed = Seed;
+  if (!Seed.getNumOccurrences()) {
+    std::random_device RD;
+    BaseSeed = (uint64_t(RD()) << 32) | RD();
+  }
+  StringSet<> ReplaySet;
+  for (auto &Name : Replay)
+    ReplaySet.insert(Name);
+
+  if (fs::is_directory(std::string{InputFile}))
+    return runCorpus(BaseSeed, ReplaySet);
+
+  std::string Out = OutputName;
+  if (!Mutants) {
+    LLVMContext Ctx;
+    auto M = parseInput(InputFile, Ctx);
+    if (!M)
+      return EXIT_FAILURE;
+    PairEmitter Emitter{*M};
+    if (!mutateModule(*M, BaseSeed, ReplaySet))
+      return EXIT_SUCCESS;
+    auto Status = Emitter.emit(*M, Out);
+    printPruneSummary();
+    return Status == EmitStatus::Ok ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  std::atomic_uint32_t Next{0};
+  std::atomic_uint32_t Emitted{0};
+  std::atomic_bool Failed{false};
+  {
+    uint32_t NumJobs =
+        Jobs ? Jobs : std::max(1U, std::thread::hardware_concurrency());
+    std::vector<std::jthread> Workers;
+    for (uint32_t I = 0; I < NumJobs; ++I)
+      Workers.emplace_back([&] {
+        // LLVMContext is not thread-safe, so each worker parses its own copy
+        // of the input and clones it for every mutant.
+        LLVMContext Ctx;
+        auto M = parseInput(InputFile, Ctx);
+        if (!M) {
+          Failed = true;
+          return;
+        }
+        PairEmitter Emitter{*M};
+        for (uint32_t K = Next++; K < Mutants && !Failed; K = Next++) {
+          auto Mutant = CloneModule(*M);
+          if (!mutateModule(*Mutant, mixSeed(BaseSeed, K), ReplaySet))
+            continue;
+          if (Emitter.emit(*Mutant, Out + "-" + std::to_string(K)) !=
+              EmitStatus::Ok)
+            Failed = true;
+          else
+            ++Emitted;
+        }
+      });
+  }
+  errs() << "Mutants: " << Emitted << " of " << Mutants << " changed (seed "
+         << BaseSeed << ")\n";
+  printPruneSummary();
+  return Failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,115 @@
+// SPDX-License-Identifier: MIT License
+// Copyright (c) 2025 Yingwei Zheng
+// This file is licensed under the MIT License.
+// See the LICENSE file for more information.
+
+// Exhaustive src -> tgt refinement check for functions with small integer
+// arguments. Every argument ranges over all of its values plus poison, and
+// the whole input space is evaluated in batches with LaneInterpreter.
+
+#pragma once
+
+#include <llvm/ADT/APInt.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/IR/Function.h>
+#include <llvm/Support/raw_ostream.h>
+#include "lane-interpreter.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace llvm {
+
+enum class RefineResult { Correct, Incorrect, Unknown };
+
+// Returns Unknown if the input space is larger than MaxInputs or the
+// functions use something the interpreter does not model. A counterexample
+// is printed to CE when the check fails.
+inline RefineResult checkRefinement(Function &Src, Function &Tgt,
+                                    uint64_t MaxInputs,
+                                    raw_ostream *CE = nullptr) {
+  constexpr uint64_t MaxBatch = 1024;
+  if (Src.getFunctionType() != Tgt.getFunctionType() ||
+      Src.getReturnType()->isVoidTy())
+    return RefineResult::Unknown;
+
+  SmallVector<uint64_t, 4> Domain;
+  uint64_t Total = 1;
+  for (auto &Arg : Src.args()) {
+    if (!Arg.getType()->isIntegerTy() ||
+        Arg.getType()->getIntegerBitWidth() >= 32)
+      return RefineResult::Unknown;
+    // All values plus poison.
+    uint64_t D = (1ULL << Arg.getType()->getIntegerBitWidth()) + 1;
+    if (Total > MaxInputs / D)
+      return RefineResult::Unknown;
+    Total *= D;
+    Domain.push_back(D);
+  }
+
+  uint32_t Batch = std::min(Total, MaxBatch);
+  LaneInterpreter SrcI{Src, Batch};
+  LaneInterpreter TgtI{Tgt, Batch};
+  if (!SrcI.isSupported() || !TgtI.isSupported())
+    return RefineResult::Unknown;
+
+  SmallVector<LaneValue, 4> Args(Src.arg_size());
+  bool Undecided = false;
+  bool TgtNonDet = false;
+  for (uint64_t Base = 0; Base < Total; Base += Batch) {
+    for (auto &Arg : Args)
+      Arg.Fields.assign(1, LaneVector(Batch));
+    for (uint32_t K = 0; K != Batch; ++K) {
+      // The last batch is padded with copies of the last input.
+      uint64_t Idx = std::min(Base + K, Total - 1);
+      for (auto &Arg : Src.args()) {
+        uint32_t ArgNo = Arg.getArgNo();
+        uint64_t D = Domain[ArgNo];
+        uint64_t V = Idx % D;
+        Idx /= D;
+        uint32_t BW = Arg.getType()->getIntegerBitWidth();
+        Args[ArgNo].lanes()[K] = V == D - 1 ? Lane{APInt::getZero(BW), true}
+                                            : Lane{APInt(BW, V), false};
+      }
+    }
+
+    if (SrcI.run(Args) != InterpStatus::Ok ||
+        TgtI.run(Args) != InterpStatus::Ok)
+      return RefineResult::Unknown;
+    TgtNonDet |= TgtI.hasNonDeterminism();
+
+    for (uint32_t K = 0; K != Batch; ++K) {
+      if (SrcI.isUB(K))
+        continue;
+      if (!TgtI.isUB(K) && refines(TgtI.getResult(), K, SrcI.getResult(), K))
+        continue;
+      // A frozen poison in src may have picked a value that matches tgt.
+      if (SrcI.hasNonDeterminism()) {
+        Undecided = true;
+        continue;
+      }
+      if (CE) {
+        for (uint32_t I = 0, E = Args.size(); I != E; ++I) {
+          *CE << "  arg" << I << " = ";
+          printLane(*CE, Args[I].lanes()[K]);
+          *CE << '\n';
+        }
+        *CE << "  src = ";
+        printLane(*CE, SrcI.getResult().lanes()[K]);
+        *CE << "\n  tgt = ";
+        if (TgtI.isUB(K))
+          *CE << "UB";
+        else
+          printLane(*CE, TgtI.getResult().lanes()[K]);
+        *CE << '\n';
+      }
+      return RefineResult::Incorrect;
+    }
+  }
+
+  // Tgt only has been checked for one choice of each frozen poison.
+  if (Undecided || TgtNonDet)
+    return RefineResult::Unknown;
+  return RefineResult::Correct;
+}
+
+} // namespace llvm
@@ -37,6 +37,7 @@
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/ToolOutputFile.h>
 #include <llvm/Support/raw_ostream.h>
+#include "function-analyses.h"
 #include <cstdint>
 #include <cstdlib>
 #include <filesystem>
@@ -233,16 +234,15 @@ int main(int argc, char **argv) {
     if (!M)
       continue;
 
+    ModuleAnalyses MA{*M};
     for (auto &F : *M) {
-      if (F.empty())
+      auto *FA = MA.getIf(F, [](const InstSummary &S) {
+        return S.has(Instruction::URem) && S.has(Instruction::PHI);
+      });
+      if (!FA)
         continue;
 
-      FunctionAnalysisManager FAM;
-      FAM.registerPass([&] { return PassInstrumentationAnalysis(); });
-      FAM.registerPass([&] { return DominatorTreeAnalysis(); });
-      FAM.registerPass([&] { return LoopAnalysis(); });
-      auto &LI = FAM.getResult<LoopAnalysis>(F);
-
+      auto &LI = FA->getLoopInfo();
       if (LI.empty())
         continue;
 
@@ -270,6 +270,7 @@ int main(int argc, char **argv) {
     errs() << "\rProgress: " << ++Count;
   }
   errs() << '\n';
+  AnalysisCounters.print(errs());
 
   for (auto &Name : Names)
     errs() << Name << '\n';
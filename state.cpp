@@ -3,7 +3,10 @@
 // This file is licensed under the MIT License.
 // See the LICENSE file for more information.
 
+#include <llvm/ADT/BitVector.h>
 #include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/ADT/DepthFirstIterator.h>
 #include <llvm/Analysis/ConstantFolding.h>
 #include <llvm/Analysis/LoopInfo.h>
 #include <llvm/IR/BasicBlock.h>
@@ -39,6 +42,8 @@
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/ToolOutputFile.h>
 #include <llvm/Support/raw_ostream.h>
+#include "function-analyses.h"
+#include "phi-scc.h"
 #include <cstdint>
 #include <cstdlib>
 #include <filesystem>
@@ -54,8 +59,156 @@ static cl::opt<std::string>
     InputDir(cl::Positional, cl::desc("<directory for input LLVM IR files>"),
              cl::Required, cl::value_desc("inputdir"));
 
+static cl::opt<bool> StateSpace(
+    "state-space",
+    cl::desc("Propagate the reachable values of the boolean PHI web of each "
+             "function and print its state-space size"),
+    cl::init(false));
+
+static cl::opt<uint32_t>
+    MaxStates("max-states",
+              cl::desc("Stop propagating after this many (block, state) "
+                       "pairs in one function"),
+              cl::init(1 << 20));
+
 std::map<uint32_t, uint32_t> PhiCountTable;
 
+// i1 PHIs whose incoming values are all 0/1 constants or other such PHIs.
+// Together they form the state of an implicit state machine.
+static PHINumbering getBooleanPHIs(Function &F) {
+  PHINumbering Candidates{F, [](PHINode &PN) {
+                            if (!PN.getType()->isIntegerTy(1))
+                              return false;
+                            for (Value *V : PN.incoming_values())
+                              if (!isa<PHINode>(V) && !match(V, m_Zero()) &&
+                                  !match(V, m_One()))
+                                return false;
+                            return true;
+                          }};
+  std::vector<bool> Alive(Candidates.size(), true);
+  for (bool Changed = true; Changed;) {
+    Changed = false;
+    for (uint32_t I = 0; I != Candidates.size(); ++I) {
+      if (!Alive[I])
+        continue;
+      for (Value *V : Candidates[I]->incoming_values()) {
+        if (!isa<PHINode>(V))
+          continue;
+        uint32_t Idx = Candidates.lookup(V);
+        if (Idx == PHINumbering::NotFound || !Alive[Idx]) {
+          Alive[I] = false;
+          Changed = true;
+          break;
+        }
+      }
+    }
+  }
+  return PHINumbering{F, [&](PHINode &PN) {
+                        uint32_t Idx = Candidates.lookup(&PN);
+                        return Idx != PHINumbering::NotFound && Alive[Idx];
+                      }};
+}
+
+struct StateSpaceInfo final {
+  uint32_t PHIs = 0;
+  // Reachable (block, state) pairs and distinct state vectors.
+  uint64_t BlockStates = 0;
+  uint64_t States = 0;
+  bool Saturated = false;
+};
+
+// A state is a bit vector over the boolean PHIs. Bits of PHIs that do not
+// dominate a block are cleared on entry, so equivalent states compare equal.
+// Conditional branches on a boolean PHI only follow the edge selected by the
+// state; all other edges are followed unconditionally.
+static StateSpaceInfo computeStateSpace(Function &F, DominatorTree &DT) {
+  StateSpaceInfo Info;
+  PHINumbering PHIs = getBooleanPHIs(F);
+  Info.PHIs = PHIs.size();
+  if (!Info.PHIs)
+    return Info;
+
+  DenseMap<const BasicBlock *, uint32_t> BlockIdx;
+  for (auto &BB : F)
+    BlockIdx.try_emplace(&BB, BlockIdx.size());
+  uint32_t NumBlocks = BlockIdx.size();
+  std::vector<BitVector> Own(NumBlocks, BitVector(Info.PHIs));
+  for (uint32_t I = 0; I != Info.PHIs; ++I)
+    Own[BlockIdx.lookup(PHIs[I]->getParent())].set(I);
+  // Bits that survive entering a block: PHIs defined in strict dominators.
+  std::vector<BitVector> Keep(NumBlocks, BitVector(Info.PHIs));
+  for (auto *Node : depth_first(DT.getRootNode())) {
+    uint32_t B = BlockIdx.lookup(Node->getBlock());
+    if (auto *IDom = Node->getIDom()) {
+      uint32_t P = BlockIdx.lookup(IDom->getBlock());
+      Keep[B] = Keep[P];
+      Keep[B] |= Own[P];
+    }
+  }
+
+  // Assignments made by the PHIs of the destination along one CFG edge.
+  struct EdgeTransfer final {
+    BitVector Ones;
+    SmallVector<std::pair<uint32_t, uint32_t>, 4> Copies;
+  };
+  DenseMap<std::pair<const BasicBlock *, const BasicBlock *>, EdgeTransfer>
+      Transfers;
+  auto GetTransfer = [&](BasicBlock *From,
+                         BasicBlock *To) -> const EdgeTransfer & {
+    auto [It, Inserted] = Transfers.try_emplace({From, To});
+    if (!Inserted)
+      return It->second;
+    auto &T = It->second;
+    T.Ones.resize(Info.PHIs);
+    for (auto I : Own[BlockIdx.lookup(To)].set_bits()) {
+      Value *V = PHIs[I]->getIncomingValueForBlock(From);
+      uint32_t Src = PHIs.lookup(V);
+      if (Src != PHINumbering::NotFound)
+        T.Copies.emplace_back(Src, I);
+      else if (match(V, m_One()))
+        T.Ones.set(I);
+    }
+    return T;
+  };
+
+  std::vector<DenseSet<BitVector>> Reached(NumBlocks);
+  DenseSet<BitVector> Distinct;
+  SmallVector<std::pair<BasicBlock *, BitVector>, 16> WorkList;
+  WorkList.emplace_back(&F.getEntryBlock(), BitVector(Info.PHIs));
+  while (!WorkList.empty()) {
+    auto [BB, State] = WorkList.pop_back_val();
+    if (!Reached[BlockIdx.lookup(BB)].insert(State).second)
+      continue;
+    Distinct.insert(State);
+    if (++Info.BlockStates >= MaxStates) {
+      Info.Saturated = true;
+      break;
+    }
+
+    auto *Term = BB->getTerminator();
+    uint32_t Taken = UINT32_MAX;
+    if (auto *BI = dyn_cast<BranchInst>(Term); BI && BI->isConditional())
+      if (uint32_t Cond = PHIs.lookup(BI->getCondition());
+          Cond != PHINumbering::NotFound)
+        Taken = State.test(Cond) ? 0 : 1;
+    for (uint32_t K = 0; K != Term->getNumSuccessors(); ++K) {
+      if (Taken != UINT32_MAX && K != Taken)
+        continue;
+      BasicBlock *Succ = Term->getSuccessor(K);
+      auto &T = GetTransfer(BB, Succ);
+      BitVector Next = State;
+      Next &= Keep[BlockIdx.lookup(Succ)];
+      Next |= T.Ones;
+      for (auto [Src, Dst] : T.Copies)
+        if (State.test(Src))
+          Next.set(Dst);
+      WorkList.emplace_back(Succ, std::move(Next));
+    }
+  }
+  Info.States = Distinct.size();
+  return Info;
+}
+
 int main(int argc, char **argv) {
   InitLLVM Init{argc, argv};
   cl::ParseCommandLineOptions(argc, argv, "scanner\n");
@@ -94,10 +247,24 @@ int main(int argc, char **argv) {
       continue;
 
     bool Contains = false;
+    ModuleAnalyses MA{*M};
     for (auto &F : *M) {
       if (F.empty())
         continue;
 
+      if (StateSpace) {
+        auto *FA = MA.getIf(
+            F, [](const InstSummary &S) { return S.has(Instruction::PHI); });
+        if (FA) {
+          auto Info = computeStateSpace(F, FA->getDomTree());
+          if (Info.PHIs)
+            outs() << fs::relative(fs::absolute(Path), BaseDir).string() << ' '
+                   << F.getName() << ' ' << Info.PHIs << ' '
+                   << Info.BlockStates << ' ' << Info.States
+                   << (Info.Saturated ? " saturated" : "") << '\n';
+        }
+      }
+
       for (auto &BB : F) {
         uint32_t PhiCount = 0;
         for (auto &PHI : BB.phis()) {
@@ -35,6 +35,8 @@
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/ToolOutputFile.h>
 #include <llvm/Support/raw_ostream.h>
+#include "function-analyses.h"
+#include "string-cache.h"
 #include <cstdint>
 #include <cstdlib>
 #include <filesystem>
@@ -50,16 +52,15 @@ static cl::opt<std::string>
     InputDir(cl::Positional, cl::desc("<directory for input LLVM IR files>"),
              cl::Required, cl::value_desc("inputdir"));
 
-static uint32_t foldStrChr(CallInst *Call, LibFunc Func) {
+static uint32_t foldStrChr(CallInst *Call, LibFunc Func,
+                           ConstantStringCache &Strings) {
   if (isa<Constant>(Call->getArgOperand(1)))
     return 0;
 
-  StringRef Str;
-  Value *Base = Call->getArgOperand(0);
-  if (!getConstantStringInfo(Base, Str, /*TrimAtNul=*/Func == LibFunc_strchr))
+  auto Ref = Strings.lookup(Call->getArgOperand(0));
+  if (!Ref)
     return 0;
-
-  uint64_t N = Str.size();
+  uint64_t N = Ref->getLength(/*TrimAtNul=*/Func == LibFunc_strchr);
   if (Func == LibFunc_memchr) {
     if (auto *ConstInt = dyn_cast<ConstantInt>(Call->getArgOperand(2))) {
       uint64_t Val = ConstInt->getZExtValue();
@@ -72,11 +73,7 @@ static uint32_t foldStrChr(CallInst *Call, LibFunc Func) {
   }
 
   // return N;
-  std::set<char> Chars;
-  for (uint64_t I = 0; I < N; ++I)
-    Chars.insert(Str[I]);
-
-  return Chars.size();
+  return Ref->countDistinctChars(N);
 }
 
 int main(int argc, char **argv) {
@@ -113,7 +110,8 @@ int main(int argc, char **argv) {
     auto M = parseIRFile(Path.string(), Err, Context);
     if (!M)
       continue;
-    TargetLibraryInfoImpl TLIImpl(Triple(M->getTargetTriple()));
+    auto &TLIImpl = getTLIImpl(*M);
+    ConstantStringCache Strings{*M};
 
     for (auto &F : *M) {
       if (F.empty())
@@ -126,7 +124,7 @@ int main(int argc, char **argv) {
           if (auto *Call = dyn_cast<CallInst>(&I)) {
             LibFunc Func;
             if (TLI.getLibFunc(*Call, Func) && (Func == LibFunc_memchr)) {
-              if (auto Len = foldStrChr(Call, Func))
+              if (auto Len = foldStrChr(Call, Func, Strings))
                 ++LenDist[Len];
             }
           }
@@ -137,6 +135,7 @@ int main(int argc, char **argv) {
     errs() << "\rProgress: " << ++Count;
   }
   errs() << '\n';
+  errs() << "Distinct strings: " << StringPool.size() << '\n';
 
   for (auto [K, V] : LenDist)
     errs() << K << ' ' << V << '\n';
@@ -33,6 +33,7 @@
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/ToolOutputFile.h>
 #include <llvm/Support/raw_ostream.h>
+#include "string-cache.h"
 #include <cstdint>
 #include <cstdlib>
 #include <filesystem>
@@ -63,6 +64,8 @@ int main(int argc, char **argv) {
   errs() << "Input files: " << InputFiles.size() << '\n';
   LLVMContext Context;
   std::map<uint32_t, uint32_t> LenDist;
+  // Operands by (length bucket, charset size) of the NUL-terminated string.
+  std::map<std::pair<uint32_t, uint32_t>, uint32_t> ClassDist;
   uint32_t Count = 0;
 
   for (auto &Path : InputFiles) {
@@ -71,21 +74,16 @@ int main(int argc, char **argv) {
     if (!M)
       continue;
 
+    ConstantStringCache Strings{*M};
     for (auto &F : *M) {
       if (F.empty())
         continue;
 
       auto Handle = [&](Value *V) {
-        if (auto *Global = dyn_cast<GlobalVariable>(V)) {
-          if (!Global->hasInitializer())
-            return;
-          if (!Global->isConstant())
-            return;
-          auto *Initializer = Global->getInitializer();
-          if (auto *Arr = dyn_cast<ConstantDataArray>(Initializer)) {
-            if (Arr->getType()->getArrayElementType()->isIntegerTy(8))
-              LenDist[Arr->getType()->getArrayNumElements()]++;
-          }
+        if (auto Ref = Strings.lookup(V)) {
+          LenDist[Ref->getLength(/*TrimAtNul=*/false)]++;
+          uint64_t Len = Ref->getLength(/*TrimAtNul=*/true);
+          ClassDist[{getLengthBucket(Len), Ref->countDistinctChars(Len)}]++;
         }
       };
 
@@ -114,5 +112,9 @@ int main(int argc, char **argv) {
   for (auto [K, V] : LenDist)
     errs() << K << ' ' << V << '\n';
 
+  errs() << "LengthBucket Charset Count\n";
+  for (auto [K, V] : ClassDist)
+    errs() << K.first << ' ' << K.second << ' ' << V << '\n';
+
   return EXIT_SUCCESS;
 }
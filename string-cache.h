@@ -0,0 +1,183 @@
+// SPDX-License-Identifier: MIT License
+// Copyright (c) 2025 Yingwei Zheng
+// This file is licensed under the MIT License.
+// See the LICENSE file for more information.
+
+// Decoded constant strings for the libcall scanners. The contents of i8
+// array initializers are interned corpus-wide in a ConstantStringPool, so
+// the NUL position and the character set of a string are computed once per
+// distinct string. A ConstantStringCache maps the globals of one module to
+// pool entries and resolves pointers into them. Other byte-readable
+// initializers (structs, wider arrays) go through getConstantStringInfo
+// once per global and offset.
+
+#pragma once
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/MathExtras.h>
+#include <algorithm>
+#include <bitset>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <utility>
+
+namespace llvm {
+
+struct ConstantString final {
+  // The whole initializer, including any NUL bytes. Empty for all-zero
+  // initializers, which are kept symbolically so that a large zero table
+  // costs no memory.
+  StringRef Bytes;
+  // Length of the initializer.
+  uint64_t Size;
+  // Position of the first NUL, or Size if there is none.
+  uint64_t NulPos;
+  // Distinct bytes before NulPos.
+  std::bitset<256> Chars;
+  bool AllZero = false;
+
+  uint64_t getCharsetSize() const { return Chars.count(); }
+};
+
+// Strings by contents. Entries stay valid for the lifetime of the pool, so
+// they outlive the modules that produced them.
+class ConstantStringPool final {
+  StringMap<ConstantString> Strings;
+  // All-zero strings by length.
+  std::map<uint64_t, ConstantString> Zeros;
+
+public:
+  const ConstantString &intern(StringRef Bytes) {
+    auto [It, Inserted] = Strings.try_emplace(Bytes);
+    auto &S = It->second;
+    if (Inserted) {
+      S.Bytes = It->first();
+      S.Size = S.Bytes.size();
+      S.NulPos = std::min(S.Bytes.find('\0'), S.Bytes.size());
+      for (unsigned char C : S.Bytes.take_front(S.NulPos))
+        S.Chars.set(C);
+    }
+    return S;
+  }
+
+  const ConstantString &internZeros(uint64_t Size) {
+    auto [It, Inserted] = Zeros.try_emplace(Size);
+    auto &S = It->second;
+    if (Inserted) {
+      S.Size = Size;
+      S.NulPos = 0;
+      S.AllZero = true;
+    }
+    return S;
+  }
+
+  uint64_t size() const { return Strings.size() + Zeros.size(); }
+};
+
+inline ConstantStringPool StringPool;
+
+// A pointer into a constant string.
+struct ConstantStringRef final {
+  const ConstantString *Str;
+  uint64_t Offset;
+
+  // Length of the string getConstantStringInfo returns: the bytes from
+  // Offset, stopping before the first NUL if TrimAtNul is set.
+  uint64_t getLength(bool TrimAtNul) const {
+    if (!TrimAtNul)
+      return Str->Size - Offset;
+    if (Offset <= Str->NulPos)
+      return Str->NulPos - Offset;
+    if (Str->AllZero)
+      return 0;
+    return std::min(Str->Bytes.find('\0', Offset), Str->Size) - Offset;
+  }
+
+  // Number of distinct bytes among the first N bytes from Offset.
+  uint64_t countDistinctChars(uint64_t N) const {
+    if (Offset == 0 && N == Str->NulPos)
+      return Str->getCharsetSize();
+    if (Str->AllZero)
+      return N != 0;
+    std::bitset<256> Chars;
+    for (unsigned char C : Str->Bytes.substr(Offset, N))
+      Chars.set(C);
+    return Chars.count();
+  }
+};
+
+// 0 for the empty string, otherwise 1 + floor(log2(Len)).
+inline uint32_t getLengthBucket(uint64_t Len) {
+  return Len ? Log2_64(Len) + 1 : 0;
+}
+
+class ConstantStringCache final {
+  const DataLayout &DL;
+  DenseMap<const GlobalVariable *, const ConstantString *> Globals;
+  // Strings read by getConstantStringInfo from globals that are not i8
+  // arrays, by global and offset. nullptr if nothing could be read.
+  DenseMap<std::pair<const GlobalVariable *, uint64_t>, const ConstantString *>
+      Fallback;
+
+public:
+  explicit ConstantStringCache(const Module &M) : DL(M.getDataLayout()) {}
+
+  // Returns nullptr unless GV is a constant with an i8 array initializer.
+  const ConstantString *get(const GlobalVariable *GV) {
+    auto [It, Inserted] = Globals.try_emplace(GV, nullptr);
+    if (!Inserted)
+      return It->second;
+    if (!GV->isConstant() || !GV->hasDefinitiveInitializer())
+      return nullptr;
+    auto *Init = GV->getInitializer();
+    auto *ArrTy = dyn_cast<ArrayType>(Init->getType());
+    if (!ArrTy || !ArrTy->getElementType()->isIntegerTy(8))
+      return nullptr;
+    if (auto *CDA = dyn_cast<ConstantDataArray>(Init))
+      It->second = &StringPool.intern(CDA->getRawDataValues());
+    else if (isa<ConstantAggregateZero>(Init))
+      It->second = &StringPool.internZeros(ArrTy->getNumElements());
+    return It->second;
+  }
+
+  // Resolves a pointer to a constant offset into a constant string.
+  std::optional<ConstantStringRef> lookup(const Value *V) {
+    if (!V->getType()->isPointerTy())
+      return std::nullopt;
+    APInt Offset(DL.getIndexTypeSizeInBits(V->getType()), 0);
+    const Value *Base = V->stripAndAccumulateConstantOffsets(
+        DL, Offset, /*AllowNonInbounds=*/true);
+    auto *GV = dyn_cast<GlobalVariable>(Base);
+    if (!GV || Offset.isNegative())
+      return std::nullopt;
+    if (auto *Str = get(GV)) {
+      if (Offset.ugt(Str->Size))
+        return std::nullopt;
+      return ConstantStringRef{Str, Offset.getZExtValue()};
+    }
+    if (!GV->isConstant() || !GV->hasDefinitiveInitializer())
+      return std::nullopt;
+
+    // The fallback string starts at the offset.
+    auto [It, Inserted] =
+        Fallback.try_emplace({GV, Offset.getZExtValue()}, nullptr);
+    if (Inserted) {
+      StringRef Bytes;
+      if (getConstantStringInfo(V, Bytes, /*TrimAtNul=*/false))
+        It->second = &StringPool.intern(Bytes);
+    }
+    if (!It->second)
+      return std::nullopt;
+    return ConstantStringRef{It->second, 0};
+  }
+};
+
+} // namespace llvm
@@ -36,6 +36,7 @@
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/ToolOutputFile.h>
 #include <llvm/Support/raw_ostream.h>
+#include "function-analyses.h"
 #include <llvm/TargetParser/Triple.h>
 #include <cstdint>
 #include <cstdlib>
@@ -90,11 +91,15 @@ int main(int argc, char **argv) {
 
     bool HasSingleBackEdge = false;
 
+    ModuleAnalyses MA{*M};
     for (auto &F : *M) {
-      if (F.empty())
+      auto *FA = MA.getIf(F, [](const InstSummary &S) {
+        return S.has(Instruction::Switch);
+      });
+      if (!FA)
         continue;
 
-      DominatorTree DT(F);
+      auto &DT = FA->getDomTree();
 
       for (auto &BB : F) {
         if (auto *SI = dyn_cast<SwitchInst>(BB.getTerminator())) {
@@ -121,6 +126,7 @@ int main(int argc, char **argv) {
     errs() << "\rProgress: " << ++Count;
   }
   errs() << '\n';
+  AnalysisCounters.print(errs());
 
   for (auto &Name : Names)
     errs() << Name << '\n';
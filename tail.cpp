@@ -40,6 +40,8 @@
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/ToolOutputFile.h>
 #include <llvm/Support/raw_ostream.h>
+#include "call-graph.h"
+#include "function-analyses.h"
 #include <cstdint>
 #include <cstdlib>
 #include <filesystem>
@@ -83,6 +85,10 @@ int main(int argc, char **argv) {
   auto BaseDir = fs::absolute(std::string(InputDir));
   uint32_t Count = 0;
   std::set<std::string> Names;
+  // Functions returning the result of a call to themselves, or only to
+  // other functions in their SCC.
+  uint32_t SelfRecursive = 0;
+  uint32_t MutuallyRecursive = 0;
 
   for (auto &Path : InputFiles) {
     SMDiagnostic Err;
@@ -95,50 +101,26 @@ int main(int argc, char **argv) {
     // errs() << DL.getStringRepresentation() << '\n';
 
     bool Contains = false;
-    for (auto &F : *M) {
-      if (F.empty())
+    ModuleCallGraph CG{*M, getTLIImpl(*M)};
+    for (auto *F : CG.functions()) {
+      if (F->getReturnType()->isVoidTy())
         continue;
-      if (F.getReturnType()->isVoidTy())
+      if (F->hasWeakAnyLinkage())
         continue;
-      if (F.hasWeakAnyLinkage())
-        continue;
-      if (F.doesNotRecurse())
-        continue;
-
-      uint32_t SelfRecursionCount = 0;
-      for (auto &BB : F) {
-        auto *Terminator = BB.getTerminator();
-        if (isa<ReturnInst>(Terminator)) {
-          auto HandleSelfCall = [&](Value *X) {
-            if (auto *Call = dyn_cast<CallInst>(X)) {
-              auto *Callee = Call->getCalledFunction();
 
-              if (Callee == &F) {
-                SelfRecursionCount++;
-              }
-            }
-          };
-
-          auto *Ret = Terminator->getOperand(0);
-          HandleSelfCall(Ret);
-
-          Value *LHS, *RHS;
-          if (match(Ret, m_BinOp(m_Value(LHS), m_Value(RHS)))) {
-            HandleSelfCall(LHS);
-            HandleSelfCall(RHS);
-          }
-
-          if (match(Ret, m_MaxOrMin(m_Value(LHS), m_Value(RHS)))) {
-            HandleSelfCall(LHS);
-            HandleSelfCall(RHS);
-          }
-        }
-      }
-
-      if (SelfRecursionCount >= 1) {
-        F.dump();
+      auto &Returns = CG.getFacts(*F).RecursiveReturns;
+      if (Returns.empty())
+        continue;
+      if (any_of(Returns, [&](const RecursiveReturn &R) {
+            return R.Call->getCalledFunction() == F;
+          }))
+        ++SelfRecursive;
+      else
+        ++MutuallyRecursive;
+
+      if (!Contains) {
+        F->dump();
         Contains = true;
-        break;
       }
     }
 
@@ -150,6 +132,8 @@ int main(int argc, char **argv) {
   }
   errs() << '\n';
 
+  errs() << "Self-recursive: " << SelfRecursive
+         << ", mutually recursive: " << MutuallyRecursive << '\n';
   errs() << Names.size() << '\n';
   for (auto &Name : Names)
     errs() << Name << '\n';
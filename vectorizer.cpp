@@ -6,6 +6,7 @@
 #include <llvm/ADT/APInt.h>
 #include <llvm/ADT/ArrayRef.h>
 #include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallPtrSet.h>
 #include <llvm/IR/Attributes.h>
 #include <llvm/IR/BasicBlock.h>
 #include <llvm/IR/Constants.h>
@@ -39,11 +40,17 @@
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/ToolOutputFile.h>
 #include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/ValueMapper.h>
+#include "lane-interpreter.h"
+#include "opt-pipeline.h"
+#include "pcg_random.hpp"
 #include <cassert>
 #include <cstdint>
 #include <cstdlib>
 #include <filesystem>
 #include <memory>
+#include <random>
 
 constexpr uint32_t Bits = 128;
 constexpr uint32_t MinBitWidth = 4;
@@ -66,6 +73,30 @@ static cl::opt<bool> AutoScale("auto-scale",
                                cl::desc("Enable auto bit width reducing"),
                                cl::init(true), cl::cat(VectorizerCategory));
 
+static cl::opt<bool>
+    Oracle("oracle",
+           cl::desc("Check each vectorized function lane by lane against the "
+                    "scalar function with random inputs"),
+           cl::init(false), cl::cat(VectorizerCategory));
+
+static cl::opt<std::string>
+    OraclePasses("oracle-passes",
+                 cl::desc("Pipeline applied to both the scalar and the "
+                          "vectorized function. The optimized vector lanes "
+                          "are compared against the unoptimized scalar "
+                          "function; the optimized scalar function is only "
+                          "checked for UB"),
+                 cl::init("instcombine"), cl::cat(VectorizerCategory));
+
+static cl::opt<uint32_t>
+    OracleInputs("oracle-inputs",
+                 cl::desc("Number of random inputs per vectorized function"),
+                 cl::init(64), cl::cat(VectorizerCategory));
+
+static cl::opt<uint64_t> OracleSeed("oracle-seed",
+                                    cl::desc("Seed for the oracle inputs"),
+                                    cl::init(0), cl::cat(VectorizerCategory));
+
 static uint32_t getTypeBits(Type *Ty, const DataLayout &DL) {
   if (Ty->isIntegerTy())
     return Ty->getScalarSizeInBits();
@@ -464,6 +495,178 @@ public:
   }
 };
 
+struct OracleStats final {
+  uint64_t Funcs = 0;
+  uint64_t Unsupported = 0;
+  uint64_t Inputs = 0;
+  uint64_t UBInputs = 0;
+  uint64_t ComparedLanes = 0;
+  uint64_t DivergedLanes = 0;
+  // Lanes skipped because a freeze of poison was taken (modelled as 0).
+  uint64_t NonDetLanes = 0;
+  // Lanes where the optimized scalar function hits UB or cannot be
+  // interpreted although the unoptimized one is fine. The vector lane is
+  // still checked against the unoptimized function.
+  uint64_t OptScalarUBLanes = 0;
+  uint64_t Mismatches = 0;
+};
+
+static OracleStats OracleStat;
+static pcg64 Rng;
+
+static APInt randomAPInt(uint32_t Bits) {
+  // Bias towards the boundary values that most folds special-case.
+  switch (std::uniform_int_distribution<uint32_t>(0, 7)(Rng)) {
+  case 0:
+    return APInt::getZero(Bits);
+  case 1:
+    return APInt(Bits, 1);
+  case 2:
+    return APInt::getAllOnes(Bits);
+  case 3:
+    return APInt::getSignedMinValue(Bits);
+  case 4:
+    return APInt::getSignedMaxValue(Bits);
+  default: {
+    SmallVector<uint64_t, 2> Words;
+    for (uint32_t I = 0; I < (Bits + 63) / 64; ++I)
+      Words.push_back(Rng());
+    return APInt(Bits, Words);
+  }
+  }
+}
+
+static void checkLanes(Function &ScalarF, Function &OptScalarF, Function &VecF,
+                       Function &OptVecF, uint32_t Count,
+                       const fs::path &Path) {
+  if (ScalarF.getReturnType()->isVoidTy() || ScalarF.arg_empty())
+    return;
+  for (auto &Arg : ScalarF.args())
+    if (!Arg.getType()->isIntegerTy())
+      return;
+  ++OracleStat.Funcs;
+
+  LaneInterpreter Scalar{ScalarF};
+  LaneInterpreter OptScalar{OptScalarF};
+  LaneInterpreter Vec{VecF};
+  LaneInterpreter OptVec{OptVecF};
+  if (!Scalar.isSupported() || !OptScalar.isSupported() ||
+      !Vec.isSupported() || !OptVec.isSupported()) {
+    ++OracleStat.Unsupported;
+    return;
+  }
+
+  auto Report = [&](StringRef Msg, ArrayRef<LaneValue> VecArgs,
+                    std::optional<uint32_t> K) {
+    ++OracleStat.Mismatches;
+    errs() << "\nMismatch: " << Path.string() << ' ' << ScalarF.getName()
+           << ": " << Msg << '\n';
+    for (uint32_t I = 0, E = VecArgs.size(); I != E; ++I) {
+      errs() << "  arg" << I << " =";
+      for (uint32_t L = 0; L != Count; ++L) {
+        if (K && L != *K)
+          continue;
+        errs() << ' ';
+        printLane(errs(), VecArgs[I].lanes()[L]);
+      }
+      errs() << '\n';
+    }
+  };
+
+  SmallVector<LaneValue, 4> VecArgs(ScalarF.arg_size());
+  SmallVector<LaneValue, 4> ScalarArgs(ScalarF.arg_size());
+  for (uint32_t Input = 0; Input != OracleInputs; ++Input) {
+    for (auto &Arg : ScalarF.args()) {
+      LaneVector Lanes;
+      for (uint32_t K = 0; K != Count; ++K)
+        Lanes.push_back(
+            Lane{randomAPInt(Arg.getType()->getScalarSizeInBits()), false});
+      VecArgs[Arg.getArgNo()].Fields.assign(1, std::move(Lanes));
+    }
+
+    if (Vec.run(VecArgs) != InterpStatus::Ok ||
+        OptVec.run(VecArgs) != InterpStatus::Ok) {
+      ++OracleStat.Unsupported;
+      return;
+    }
+    ++OracleStat.Inputs;
+    if (Vec.isUB()) {
+      ++OracleStat.UBInputs;
+      continue;
+    }
+    if (OptVec.isUB()) {
+      Report("optimized vector function triggers UB", VecArgs, std::nullopt);
+      return;
+    }
+
+    // A frozen poison lane may legitimately differ between the scalar and
+    // vector functions.
+    bool VecNonDet = Vec.hasNonDeterminism() || OptVec.hasNonDeterminism();
+
+    // The last lane is skipped since getMappedValue plants poison there.
+    for (uint32_t K = 0; K + 1 < Count; ++K) {
+      for (uint32_t I = 0, E = VecArgs.size(); I != E; ++I)
+        ScalarArgs[I].Fields.assign(1, LaneVector{VecArgs[I].lanes()[K]});
+      if (Scalar.run(ScalarArgs) != InterpStatus::Ok || Scalar.isUB())
+        continue;
+      // Branches in the vectorized function are taken on the reduced
+      // condition, so only lanes that follow the same path are comparable.
+      if (!Scalar.getTrace().equals(Vec.getTrace())) {
+        ++OracleStat.DivergedLanes;
+        continue;
+      }
+      bool OptScalarOk =
+          OptScalar.run(ScalarArgs) == InterpStatus::Ok && !OptScalar.isUB();
+      if (!OptScalarOk) {
+        ++OracleStat.OptScalarUBLanes;
+        errs() << "\nOptimized scalar UB: " << Path.string() << ' '
+               << ScalarF.getName() << ": lane " << K << '\n';
+      }
+      if (VecNonDet || Scalar.hasNonDeterminism() ||
+          (OptScalarOk && OptScalar.hasNonDeterminism())) {
+        ++OracleStat.NonDetLanes;
+        continue;
+      }
+      ++OracleStat.ComparedLanes;
+      // The unoptimized scalar function is the reference, so a miscompile
+      // of the scalar function is not blamed on the vector one.
+      if (!refines(OptVec.getResult(), K, Scalar.getResult(), 0)) {
+        std::string Msg;
+        raw_string_ostream OS(Msg);
+        OS << "lane " << K << " expected ";
+        printLane(OS, Scalar.getResult().lanes().front());
+        OS << " got ";
+        printLane(OS, OptVec.getResult().lanes()[K]);
+        Report(Msg, VecArgs, K);
+        return;
+      }
+    }
+  }
+}
+
+static void runOracle(Module &M, Module &NewM,
+                      ArrayRef<std::pair<Function *, uint32_t>> Funcs,
+                      OptPipeline &Pipeline, const fs::path &Path) {
+  SmallPtrSet<const GlobalValue *, 8> Wanted;
+  for (auto [F, Count] : Funcs)
+    Wanted.insert(F);
+  ValueToValueMapTy VMap;
+  auto OptM = CloneModule(
+      M, VMap, [&](const GlobalValue *GV) { return Wanted.contains(GV); });
+  auto OptNewM = CloneModule(NewM);
+  Pipeline.run(*OptM);
+  Pipeline.run(*OptNewM);
+
+  for (auto [F, Count] : Funcs) {
+    auto *OptF = OptM->getFunction(F->getName());
+    auto *VecF = NewM.getFunction(F->getName());
+    auto *OptVecF = OptNewM->getFunction(F->getName());
+    if (!OptF || !VecF || !OptVecF || OptF->empty() || OptVecF->empty())
+      continue;
+    checkLanes(*F, *OptF, *VecF, *OptVecF, Count, Path);
+  }
+}
+
 int main(int argc, char **argv) {
   InitLLVM Init{argc, argv};
   cl::ParseCommandLineOptions(
@@ -489,6 +692,16 @@ int main(int argc, char **argv) {
     fs::remove_all(OutputBase);
   fs::create_directories(OutputBase);
 
+  std::unique_ptr<OptPipeline> Pipeline;
+  if (Oracle) {
+    Rng.seed(OracleSeed);
+    Pipeline = std::make_unique<OptPipeline>();
+    if (auto Err = Pipeline->parse(OraclePasses)) {
+      errs() << toString(std::move(Err)) << '\n';
+      return EXIT_FAILURE;
+    }
+  }
+
   for (auto &Path : InputFiles) {
     // errs() << Path.string() << '\n';
 
@@ -498,6 +711,7 @@ int main(int argc, char **argv) {
       continue;
 
     Module NewM("", Context);
+    SmallVector<std::pair<Function *, uint32_t>, 8> OracleFuncs;
     for (auto &F : *M) {
       if (F.empty())
         continue;
@@ -533,6 +747,9 @@ int main(int argc, char **argv) {
         NewF->dump();
         std::abort();
       }
+      // Lanes of a narrowed function cannot be compared with the original.
+      if (Oracle && Scale == 1U)
+        OracleFuncs.emplace_back(&F, MaxElementCount);
     }
 
     bool Valid = false;
@@ -564,9 +781,24 @@ int main(int argc, char **argv) {
     NewM.print(Out->os(), /*AAW=*/nullptr);
     Out->keep();
 
+    if (Pipeline && !OracleFuncs.empty())
+      runOracle(*M, NewM, OracleFuncs, *Pipeline, Path);
+
     errs() << "\rProgress: " << ++Count;
   }
   errs() << '\n';
 
+  if (Oracle) {
+    errs() << "Oracle functions: " << OracleStat.Funcs << '\n';
+    errs() << "Oracle unsupported: " << OracleStat.Unsupported << '\n';
+    errs() << "Oracle inputs: " << OracleStat.Inputs << " (UB "
+           << OracleStat.UBInputs << ")\n";
+    errs() << "Oracle lanes: " << OracleStat.ComparedLanes << " (diverged "
+           << OracleStat.DivergedLanes << ", nondeterministic "
+           << OracleStat.NonDetLanes << ", optimized scalar UB "
+           << OracleStat.OptScalarUBLanes << ")\n";
+    errs() << "Oracle mismatches: " << OracleStat.Mismatches << '\n';
+  }
+
   return EXIT_SUCCESS;
 }